@@ -2,8 +2,10 @@
 #include <thread>
 #include <stdexcept>
 #include <boost/program_options.hpp>
+#include <cppkafka/consumer.h>
 #include "consumer_offset_reader.h"
 #include "detail/logging.h"
+#include "utils/utils.h"
 
 using std::cout;
 using std::endl;
@@ -15,18 +17,41 @@ using std::cin;
 using std::exception;
 
 using std::chrono::seconds;
+using std::chrono::minutes;
 
 using cppkafka::Configuration;
+using cppkafka::Consumer;
 
 using pirulo::ConsumerOffsetReader;
 using pirulo::OffsetStore;
 using pirulo::logging::register_console_logger;
+using pirulo::utils::generate_group_id;
+using pirulo::utils::get_group_offsets_partition;
 
 namespace po = boost::program_options;
 
+static void print_offsets(const OffsetStore& store, const string& consumer_group,
+                          unsigned lookback = 0) {
+    auto offsets = store.get_consumer_offsets(consumer_group);
+    if (offsets.empty() && lookback > 0) {
+        cout << "No offsets found for consumer within the last " << lookback << " minutes\n";
+    }
+    else if (offsets.empty()) {
+        cout << "Consumer not found\n";
+    }
+    else {
+        for (const auto& offset : offsets) {
+            cout << offset.get_topic_partition() << ": "
+                 << offset.get_topic_partition().get_offset() << endl;
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
     string brokers;
     string group_id;
+    string lookup_group;
+    unsigned lookback;
 
     po::options_description options("Options");
     options.add_options()
@@ -35,6 +60,12 @@ int main(int argc, char* argv[]) {
                          "the kafka broker list")
         ("group-id,g",   po::value<string>(&group_id),
                          "the consumer group id to be used")
+        ("lookup,l",     po::value<string>(&lookup_group),
+                         "print this group's offsets by only reading the __consumer_offsets "
+                         "partition it lives in")
+        ("lookback,L",   po::value<unsigned>(&lookback)->default_value(0),
+                         "when looking up a group, only read the last N minutes of records. "
+                         "0 reads the whole partition")
         ;
 
     po::variables_map vm;
@@ -52,6 +83,10 @@ int main(int argc, char* argv[]) {
 
     register_console_logger();
 
+    if (group_id.empty()) {
+        group_id = generate_group_id();
+    }
+
     // Construct the configuration
     Configuration config = {
         { "metadata.broker.list", brokers },
@@ -61,6 +96,34 @@ int main(int argc, char* argv[]) {
     };
 
     auto store = make_shared<OffsetStore>();
+    if (!lookup_group.empty()) {
+        // Find out which partition the group lives in and only load that one
+        size_t partition_count = 0;
+        try {
+            Consumer consumer(config);
+            partition_count = consumer.get_metadata(consumer.get_topic("__consumer_offsets"))
+                                      .get_partitions().size();
+        }
+        catch (const cppkafka::Exception& ex) {
+            cout << "Failed to fetch __consumer_offsets metadata: " << ex.what() << endl;
+            return 1;
+        }
+        if (partition_count == 0) {
+            cout << "__consumer_offsets has no partitions" << endl;
+            return 1;
+        }
+        const int partition = get_group_offsets_partition(lookup_group, partition_count);
+        ConsumerOffsetReader reader(store, seconds(10), move(config));
+        reader.set_manual_assignment(true);
+        reader.set_partitions({ partition });
+        reader.set_cold_start_horizon(minutes(lookback));
+        reader.run([&]() {
+            reader.stop();
+        });
+        print_offsets(*store, lookup_group, lookback);
+        return 0;
+    }
+
     auto on_eof = [&]() {
         cout << "Reached EOF on all partitions\n";
     };
@@ -71,18 +134,9 @@ int main(int argc, char* argv[]) {
 
     string consumer_group;
     while (cin >> consumer_group) {
-        auto offsets = store->get_consumer_offsets(consumer_group);
-        if (offsets.empty()) {
-            cout << "Consumer not found\n";
-        }
-        else {
-            for (const auto& offset : offsets) {
-                cout << offset.get_topic_partition() << ": "
-                     << offset.get_topic_partition().get_offset() << endl;
-            }
-        }
+        print_offsets(*store, consumer_group);
     }
 
     reader.stop();
     th.join();
-}
\ No newline at end of file
+}
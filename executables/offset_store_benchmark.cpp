@@ -0,0 +1,208 @@
+#include <iostream>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "offset_store.h"
+#include "detail/logging.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::to_string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::exception;
+using std::max;
+using std::mt19937;
+using std::uniform_int_distribution;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::milli;
+
+using pirulo::OffsetStore;
+using pirulo::ConsumerOffset;
+using pirulo::logging::register_console_logger;
+
+namespace po = boost::program_options;
+
+struct BenchmarkParameters {
+    size_t group_count;
+    size_t topic_count;
+    size_t partition_count;
+    size_t operation_count;
+};
+
+// Runs thread_count writers and thread_count readers concurrently against a store and returns
+// the amount of operations per second across all of them
+double run_benchmark(const BenchmarkParameters& parameters, size_t thread_count) {
+    OffsetStore store;
+    vector<string> groups;
+    for (size_t i = 0; i < parameters.group_count; ++i) {
+        groups.emplace_back("group-" + to_string(i));
+    }
+    vector<string> topics;
+    for (size_t i = 0; i < parameters.topic_count; ++i) {
+        topics.emplace_back("topic-" + to_string(i));
+    }
+
+    atomic<bool> started{false};
+    vector<thread> threads;
+    for (size_t i = 0; i < thread_count * 2; ++i) {
+        const bool is_writer = i % 2 == 0;
+        threads.emplace_back([&, i, is_writer] {
+            mt19937 generator(i);
+            uniform_int_distribution<size_t> group_distribution(0, groups.size() - 1);
+            uniform_int_distribution<size_t> topic_distribution(0, topics.size() - 1);
+            uniform_int_distribution<int> partition_distribution(0,
+                parameters.partition_count - 1);
+            while (!started) {
+                std::this_thread::yield();
+            }
+            for (size_t j = 0; j < parameters.operation_count; ++j) {
+                const string& group_id = groups[group_distribution(generator)];
+                const string& topic = topics[topic_distribution(generator)];
+                const int partition = partition_distribution(generator);
+                // Writers alternate between commits and topic offsets, like the readers do
+                if (is_writer) {
+                    if (j % 2 == 0) {
+                        store.store_consumer_offset(group_id, topic, partition, j);
+                    }
+                    else {
+                        store.store_topic_offset(topic, partition, j);
+                    }
+                }
+                else {
+                    if (j % 2 == 0) {
+                        store.get_consumer_offsets(group_id);
+                    }
+                    else {
+                        store.get_topic_offset(topic, partition);
+                    }
+                }
+            }
+        });
+    }
+
+    const auto start = steady_clock::now();
+    started = true;
+    for (thread& th : threads) {
+        th.join();
+    }
+    const duration<double> elapsed = steady_clock::now() - start;
+    return threads.size() * parameters.operation_count / elapsed.count();
+}
+
+// Fills a store where every group consumes every partition of one topic and compares the
+// time it takes to compute every lag by querying each group against doing it in bulk
+void run_lag_benchmark(const BenchmarkParameters& parameters) {
+    OffsetStore store;
+    for (size_t i = 0; i < parameters.topic_count; ++i) {
+        for (size_t partition = 0; partition < parameters.partition_count; ++partition) {
+            store.store_topic_offset("topic-" + to_string(i), partition, 1000);
+        }
+    }
+    for (size_t i = 0; i < parameters.group_count; ++i) {
+        const string topic = "topic-" + to_string(i % parameters.topic_count);
+        for (size_t partition = 0; partition < parameters.partition_count; ++partition) {
+            store.store_consumer_offset("group-" + to_string(i), topic, partition, i % 1000);
+        }
+    }
+    store.publish();
+
+    auto start = steady_clock::now();
+    int64_t query_lag = 0;
+    for (const string& group_id : store.get_consumers()) {
+        for (const ConsumerOffset& consumer_offset : store.get_consumer_offsets(group_id)) {
+            const auto& topic_partition = consumer_offset.get_topic_partition();
+            const auto topic_offset = store.get_topic_offset(topic_partition.get_topic(),
+                                                             topic_partition.get_partition());
+            if (topic_offset) {
+                query_lag += max<int64_t>(0, *topic_offset - topic_partition.get_offset());
+            }
+        }
+    }
+    const duration<double, milli> query_elapsed = steady_clock::now() - start;
+
+    start = steady_clock::now();
+    const OffsetStore::LagColumns lags = store.compute_all_lags();
+    int64_t bulk_lag = 0;
+    for (const int64_t lag : lags.lags) {
+        bulk_lag += lag;
+    }
+    const duration<double, milli> bulk_elapsed = steady_clock::now() - start;
+
+    cout << "Lag of " << lags.lags.size() << " offsets: " << query_elapsed.count()
+         << "ms querying each group, " << bulk_elapsed.count() << "ms in bulk"
+         << (query_lag == bulk_lag ? "" : " (MISMATCH)") << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkParameters parameters;
+    unsigned max_threads;
+
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h",       "produce this help message")
+        ("groups,g",     po::value<size_t>(&parameters.group_count)->default_value(10000),
+                         "amount of consumer groups")
+        ("topics,t",     po::value<size_t>(&parameters.topic_count)->default_value(1000),
+                         "amount of topics")
+        ("partitions,p", po::value<size_t>(&parameters.partition_count)->default_value(16),
+                         "amount of partitions per topic")
+        ("operations,o", po::value<size_t>(&parameters.operation_count)->default_value(200000),
+                         "amount of operations each thread performs")
+        ("max-threads,m", po::value<unsigned>(&max_threads)->default_value(
+                             thread::hardware_concurrency() / 2),
+                         "maximum amount of writer threads, each with its own reader thread")
+        ;
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+        po::notify(vm);
+    }
+    catch (const exception& ex) {
+        cout << "Error parsing options: " << ex.what() << endl;
+        cout << endl;
+        cout << options << endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        cout << options << endl;
+        return 0;
+    }
+    if (parameters.group_count == 0 || parameters.topic_count == 0 ||
+        parameters.partition_count == 0) {
+        cout << "Groups, topics and partitions must be positive" << endl;
+        return 1;
+    }
+
+    register_console_logger("", "WARN");
+
+    // Threads beyond the amount of cores only take turns, which says nothing about locking
+    const unsigned core_count = thread::hardware_concurrency();
+    if (core_count < max(max_threads, 1u) * 2) {
+        cout << "Warning: " << core_count << " hardware threads available, runs using more "
+             << "than that don't show how the store scales" << endl;
+    }
+    // Double the thread count every time so scaling is easy to see
+    double baseline = 0;
+    for (unsigned thread_count = 1; thread_count <= max(max_threads, 1u);
+         thread_count *= 2) {
+        const double throughput = run_benchmark(parameters, thread_count);
+        if (baseline == 0) {
+            baseline = throughput;
+        }
+        cout << thread_count << " writers + " << thread_count << " readers: "
+             << static_cast<uint64_t>(throughput) << " ops/s ("
+             << throughput / baseline << "x)" << endl;
+    }
+    run_lag_benchmark(parameters);
+}
@@ -2,9 +2,12 @@
 
 #include <memory>
 #include <vector>
+#include <chrono>
 #include "topic_offset_reader.h"
 #include "consumer_offset_reader.h"
+#include "offset_store_snapshot.h"
 #include "plugin_base.h"
+#include "utils/task_scheduler.h"
 
 namespace pirulo {
 
@@ -20,12 +23,30 @@ public:
     void stop();
 
     void add_plugin(PluginPtr plugin);
+    // Loads the store from the given file on startup and periodically saves it there once
+    // the consumer offsets are loaded
+    void enable_snapshots(std::string path, std::chrono::seconds interval);
+    // Periodically removes the groups that haven't committed in this long, once the consumer
+    // offsets are loaded
+    void enable_consumer_eviction(std::chrono::seconds ttl);
+    // Periodically logs the estimated memory used by each structure, along with the groups
+    // and topics using the most
+    void enable_memory_reports(std::chrono::seconds interval);
 private:
     void process();
+    void load_snapshot();
+    void save_snapshot();
+    void evict_consumers();
+    void report_memory_usage();
 
     std::vector<PluginPtr> plugins_;
     TopicOffsetReaderPtr topic_reader_;
     ConsumerOffsetReaderPtr consumer_reader_;
+    std::unique_ptr<OffsetStoreSnapshot> snapshot_;
+    std::chrono::seconds snapshot_interval_{0};
+    std::chrono::seconds consumer_ttl_{0};
+    std::chrono::seconds memory_report_interval_{0};
+    TaskScheduler task_scheduler_;
 };
 
 } // pirulo
@@ -2,10 +2,15 @@
 
 #include <memory>
 #include <set>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
 #include <cppkafka/consumer.h>
-#include <cppkafka/utils/consumer_dispatcher.h>
 #include "offset_store.h"
 #include "utils/observer.h"
+#include "utils/string_interner.h"
 
 namespace pirulo {
 
@@ -15,24 +20,129 @@ public:
     using EofCallback = std::function<void()>;
     using TopicCommitCallback = std::function<void(const std::string&, int)>;
 
+    // librdkafka options, which override the ones in the reader's configuration, and
+    // batching parameters used while consuming
+    struct ConsumptionProfile {
+        std::map<std::string, std::string> options;
+        size_t batch_size;
+        std::chrono::milliseconds batch_timeout;
+    };
+
     ConsumerOffsetReader(StorePtr store, std::chrono::milliseconds consumer_offset_cool_down,
                          cppkafka::Configuration config);
+    // Uses thread_count consumers, each running on its own thread. All of them belong to the
+    // same consumer group so the __consumer_offsets partitions are spread among them. The
+    // thread count shouldn't be larger than the amount of partitions in that topic
+    ConsumerOffsetReader(StorePtr store, size_t thread_count,
+                         std::chrono::milliseconds consumer_offset_cool_down,
+                         cppkafka::Configuration config);
 
     void run(const EofCallback& callback);
     void stop();
 
+    // Assign every __consumer_offsets partition explicitly rather than subscribing to it.
+    // This avoids joining a consumer group, so no coordinator or rebalances are involved
+    void set_manual_assignment(bool enabled);
+    // Only consume these __consumer_offsets partitions when using manual assignment. Every
+    // partition is consumed if this is empty
+    void set_partitions(std::set<int> partitions);
+    // When loading a partition from scratch, skip the records older than this. These belong to
+    // commits the broker considers expired (see offsets.retention.minutes). A zero horizon,
+    // the default, replays every partition from the beginning, which is also what's done if
+    // the offsets for the horizon can't be found
+    void set_cold_start_horizon(std::chrono::milliseconds horizon);
+    // The cold start profile is used until every partition reaches EOF. At that point the
+    // consumers are recreated using the steady state one. By default the former favors
+    // throughput and the latter latency. Subscribed consumers leave and join their group again
+    // to do so, so this costs a rebalance of __consumer_offsets, one per consumer at worst if
+    // they don't switch at the same time. No commits are read while it lasts
+    void set_cold_start_profile(ConsumptionProfile profile);
+    void set_steady_state_profile(ConsumptionProfile profile);
+
     void watch_commits(const std::string& topic, int partition, TopicCommitCallback callback);
+    void unwatch_commits(const std::string& topic, int partition);
 
     StorePtr get_store() const;
+    // Estimated memory used by commit watches
+    std::vector<MemoryUsage> get_memory_usage() const;
+
+    // The state of the group described by a group metadata record's value. Returns none if
+    // the value's version isn't known, throws ParseException if it's malformed
+    static boost::optional<OffsetStore::ConsumerGroupState>
+    parse_group_metadata(const cppkafka::Buffer& value);
 private:
-    void handle_message(const cppkafka::Message& msg);
+    // A (group, topic, partition) whose strings live in a consumer's string interner
+    struct CommitKey {
+        const std::string* group_id;
+        const std::string* topic;
+        int partition;
+
+        bool operator==(const CommitKey& rhs) const;
+    };
+
+    struct CommitKeyHasher {
+        size_t operator()(const CommitKey& key) const;
+    };
+
+    struct CoalescedCommit {
+        int64_t offset;
+        bool removed;
+        int offsets_partition;
+        int64_t timestamp;
+    };
+
+    using CoalescedCommitMap = std::unordered_map<CommitKey, CoalescedCommit, CommitKeyHasher>;
+
+    // Everything a single consumption thread uses
+    struct ConsumerContext {
+        std::unique_ptr<cppkafka::Consumer> consumer;
+        const ConsumptionProfile* profile{nullptr};
+        StringInterner interned_strings;
+        // Updates parsed from the current batch
+        std::vector<OffsetStore::ConsumerOffsetUpdate> updates;
+        // Latest commit for each key seen while loading and not yet applied to the store
+        CoalescedCommitMap coalesced_commits;
+        // Latest state of every group whose metadata changed since updates were last applied
+        std::unordered_map<const std::string*, OffsetStore::ConsumerGroupState> group_states;
+        // Next offset to be read on each partition touched since updates were last applied
+        std::map<int, int64_t> positions;
+        // Partitions to consume when using manual assignment
+        cppkafka::TopicPartitionList assignment;
+        bool assigned{false};
+    };
+    using ConsumerContextPtr = std::unique_ptr<ConsumerContext>;
+
+    void create_consumer(ConsumerContext& context, const ConsumptionProfile& profile);
+    bool assign_partitions();
+    void start_consumption(ConsumerContext& context);
+    void subscribe(ConsumerContext& context);
+    void set_starting_offsets(cppkafka::Consumer& consumer,
+                              cppkafka::TopicPartitionList& topic_partitions) const;
+    void run_consumer(ConsumerContext& context, const EofCallback& callback);
+    void switch_to_steady_state(ConsumerContext& context);
+    void handle_eofs(const std::vector<int>& partitions, const EofCallback& callback);
+    void handle_message(ConsumerContext& context, const cppkafka::Message& msg);
+    void handle_group_metadata(ConsumerContext& context, const std::string& group_id,
+                               const cppkafka::Message& msg);
+    void coalesce_updates(ConsumerContext& context);
+    void flush_updates(ConsumerContext& context);
+    void apply_updates(ConsumerContext& context);
 
     StorePtr store_;
-    cppkafka::Consumer consumer_;
-    cppkafka::ConsumerDispatcher dispatcher_{consumer_};
+    cppkafka::Configuration config_;
+    ConsumptionProfile cold_start_profile_;
+    ConsumptionProfile steady_state_profile_;
+    std::vector<ConsumerContextPtr> consumers_;
     Observer<cppkafka::TopicPartition> observer_;
     std::set<int> pending_partitions_;
-    bool notifications_enabled_{false};
+    size_t assigned_consumers_{0};
+    std::atomic<bool> finished_loading_{false};
+    std::mutex pending_partitions_mutex_;
+    std::atomic<bool> notifications_enabled_{false};
+    std::atomic<bool> running_{true};
+    bool manual_assignment_{false};
+    std::set<int> partitions_;
+    std::chrono::milliseconds cold_start_horizon_{0};
 };
 
 } // pirulo
@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
 #include <cppkafka/buffer.h>
 #include "../exceptions.h"
 #include "endianness.h"
@@ -20,6 +22,11 @@ void read_value(const uint8_t* buffer, T& value) {
     std::memcpy(&value, buffer, sizeof(value));
 }
 
+template <typename T>
+void write_value(uint8_t* buffer, const T& value) {
+    std::memcpy(buffer, &value, sizeof(value));
+}
+
 class InputMemoryStream {
 public:
     InputMemoryStream(const uint8_t* buffer, size_t total_sz)
@@ -65,6 +72,16 @@ public:
         skip(length);
     }
 
+    // Reads a string without copying it. The view points into the underlying buffer
+    void read(boost::string_ref& value) {
+        uint16_t length = read_be<uint16_t>();
+        if (!can_read(length)) {
+            throw ParseException();
+        }
+        value = boost::string_ref(reinterpret_cast<const char*>(pointer()), length);
+        skip(length);
+    }
+
     void skip(size_t size) {
         if (size > size_) {
             throw ParseException();
@@ -105,4 +122,44 @@ private:
     size_t size_;
 };
 
+// Unlike the libtins one, this appends to a growing buffer
+class OutputMemoryStream {
+public:
+    OutputMemoryStream(std::vector<uint8_t>& buffer)
+    : buffer_(buffer) {
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        const size_t position = buffer_.size();
+        buffer_.resize(position + sizeof(value));
+        write_value(&buffer_[position], value);
+    }
+
+    template <typename T>
+    void write_le(const T& value) {
+        write(endian::host_to_le(value));
+    }
+
+    template <typename T>
+    void write_be(const T& value) {
+        write(endian::host_to_be(value));
+    }
+
+    // Strings are prefixed by their length, the same way InputMemoryStream expects them
+    void write(const std::string& value) {
+        if (value.size() > UINT16_MAX) {
+            throw Exception("String too long to be serialized");
+        }
+        write_be<uint16_t>(value.size());
+        buffer_.insert(buffer_.end(), value.begin(), value.end());
+    }
+
+    size_t size() const {
+        return buffer_.size();
+    }
+private:
+    std::vector<uint8_t>& buffer_;
+};
+
 } // pirulo
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <boost/optional.hpp>
+#include "utils/indexed_heap.h"
+
+namespace pirulo {
+
+// Lag aggregates per group, per group and topic and per topic, kept up to date as offsets
+// and watermarks change so reading one doesn't depend on the amount of groups or topics.
+//
+// A commit only changes the aggregates its group and topic are part of. A watermark change
+// changes the lag of every group consuming that partition, so its cost is proportional to
+// them. Lag is only known for offsets on partitions that have a watermark and, like
+// everywhere else, it's never negative.
+//
+// The offsets and groups with the largest lag are kept in heaps, so finding the worst ones
+// doesn't need a scan either. Every lag change moves them in O(log n). Groups that are known
+// to have no members are kept out of them, as their lag only grows until they expire.
+//
+// This class is thread safe.
+class LagRollups {
+public:
+    // Lag of a set of offsets
+    struct Rollup {
+        int64_t total_lag;
+        // Offsets whose lag is known
+        size_t offset_count;
+
+        bool operator==(const Rollup& rhs) const;
+    };
+
+    struct PartitionLag {
+        std::string group_id;
+        std::string topic;
+        int partition;
+        int64_t lag;
+
+        bool operator==(const PartitionLag& rhs) const;
+    };
+
+    struct GroupLag {
+        std::string group_id;
+        int64_t total_lag;
+        size_t offset_count;
+
+        bool operator==(const GroupLag& rhs) const;
+    };
+
+    void store_consumer_offset(const std::string& group_id, const std::string& topic,
+                               int partition, int64_t offset);
+    void remove_consumer_offset(const std::string& group_id, const std::string& topic,
+                                int partition);
+    void store_topic_offset(const std::string& topic, int partition, int64_t offset);
+    // Forgets a topic's watermarks. Offsets still committed on it stay, without a known lag
+    void remove_topic(const std::string& topic);
+    // Inactive groups still count towards every rollup but are left out of the largest
+    // lags. Groups are active unless told otherwise, even before they have any offsets
+    void set_group_active(const std::string& group_id, bool active);
+    // Forgets everything
+    void clear();
+
+    // These return none if no offset in them has a known lag
+    boost::optional<Rollup> get_consumer_lag(const std::string& group_id) const;
+    boost::optional<Rollup> get_consumer_lag(const std::string& group_id,
+                                             const std::string& topic) const;
+    // Largest lag among the group's partitions of a topic
+    boost::optional<int64_t> get_consumer_max_lag(const std::string& group_id,
+                                                  const std::string& topic) const;
+    boost::optional<Rollup> get_topic_lag(const std::string& topic) const;
+    // The offsets with the largest lag and the groups with the largest total lag, largest
+    // first, among active groups. These take O(count log count) regardless of how many
+    // there are
+    std::vector<PartitionLag> get_largest_partition_lags(size_t count) const;
+    std::vector<GroupLag> get_largest_consumer_lags(size_t count) const;
+    // Amount of offsets tracked and the estimated bytes used by them
+    size_t get_offset_count() const;
+    size_t get_memory_usage() const;
+private:
+    static constexpr int64_t NO_WATERMARK = -1;
+    static constexpr int64_t NO_LAG = -1;
+
+    struct Aggregate {
+        int64_t total_lag{0};
+        size_t lag_count{0};
+        // Every offset, including the ones whose lag isn't known
+        size_t offset_count{0};
+
+        void add(int64_t lag);
+        void remove(int64_t lag);
+        boost::optional<Rollup> get_rollup() const;
+    };
+
+    // A group's offsets on a topic. Only these keep every lag, to know the largest one
+    struct GroupTopicAggregate : Aggregate {
+        // Tree where each node is the largest of its two children. The second half holds
+        // the lag of each partition, or NO_LAG if it isn't known
+        std::vector<int64_t> partition_lags;
+
+        void set_lag(int partition, int64_t lag);
+        int64_t get_max_lag() const;
+    };
+
+    struct TrackedOffset;
+    struct GroupAggregate;
+
+    // Offsets by lag and groups by total lag
+    using PartitionLagHeap = IndexedHeap<TrackedOffset, int64_t>;
+    using GroupLagHeap = IndexedHeap<GroupAggregate, int64_t>;
+
+    struct TopicState;
+
+    // Names are only stored as the keys of groups and topics, everything else points to
+    // those. Aggregates and keys are hash map nodes so these pointers stay valid until
+    // they're erased, and a group or topic is only erased once nothing points to it
+    struct GroupAggregate : Aggregate {
+        std::unordered_map<const TopicState*, GroupTopicAggregate> topics;
+        const std::string* group_id{nullptr};
+        // Only there while some lag is known and the group is active
+        size_t heap_index{GroupLagHeap::NOT_IN_HEAP};
+        bool is_active{true};
+    };
+
+    struct TrackedOffset {
+        int64_t offset{0};
+        int32_t partition{0};
+        int64_t lag{NO_LAG};
+        const std::string* topic{nullptr};
+        GroupAggregate* group{nullptr};
+        GroupTopicAggregate* group_topic{nullptr};
+        // Only there while its lag is known and its group is active
+        size_t heap_index{PartitionLagHeap::NOT_IN_HEAP};
+    };
+
+    struct PartitionState {
+        int64_t watermark{NO_WATERMARK};
+        std::unordered_map<const GroupAggregate*, TrackedOffset> consumer_offsets;
+    };
+
+    struct TopicState : Aggregate {
+        // Growing a deque doesn't move its elements, so offsets can be pointed to
+        std::deque<PartitionState> partitions;
+        // Removed topics are kept until their last offset is removed
+        bool is_removed{false};
+    };
+
+    static boost::optional<int64_t> compute_lag(int64_t watermark, int64_t offset);
+    const GroupTopicAggregate* find_group_topic(const std::string& group_id,
+                                                const std::string& topic) const;
+    static PartitionState& get_partition(TopicState& state, int partition);
+    void update_lag(TopicState& state, TrackedOffset& tracked_offset,
+                    const boost::optional<int64_t>& old_lag,
+                    const boost::optional<int64_t>& new_lag);
+
+    std::unordered_map<std::string, GroupAggregate> groups_;
+    std::unordered_map<std::string, TopicState> topics_;
+    std::unordered_set<std::string> inactive_groups_;
+    PartitionLagHeap partition_lags_;
+    GroupLagHeap group_lags_;
+    size_t offset_count_{0};
+    mutable std::mutex mutex_;
+};
+
+} // pirulo
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <boost/optional.hpp>
+
+namespace pirulo {
+
+// Bounded series of (timestamp, offset) samples.
+//
+// Samples are compressed the way Gorilla does it: each one is stored as the difference
+// between its delta and the previous sample's delta, zigzag and varint encoded. Regularly
+// spaced samples of steadily moving offsets take a couple of bytes each.
+//
+// Samples are appended into blocks. Once the series is larger than its maximum size, the
+// oldest blocks are dropped.
+//
+// This class is not thread safe.
+class OffsetHistory {
+public:
+    struct Sample {
+        // Milliseconds since epoch
+        int64_t timestamp;
+        int64_t offset;
+
+        bool operator==(const Sample& rhs) const;
+    };
+
+    OffsetHistory(size_t maximum_size);
+
+    // Samples older than the latest one are ignored
+    void add_sample(int64_t timestamp, int64_t offset);
+    // Returns the samples whose timestamps are within [start, end]
+    std::vector<Sample> get_samples(int64_t start, int64_t end) const;
+    // Estimates when the series reached an offset by interpolating between the latest sample
+    // at or below it and the one after it. Returns none if no sample is above the offset, or
+    // if every sample is and so it was reached before the series starts
+    boost::optional<int64_t> find_timestamp(int64_t offset) const;
+    bool empty() const;
+    // Amount of bytes used by the samples
+    size_t get_size() const;
+    // The most bytes the samples can ever use. This is the maximum size unless it's smaller
+    // than a single block
+    size_t get_maximum_size() const;
+private:
+    struct Block {
+        Sample first;
+        Sample last;
+        // Lets lookups skip blocks without decoding them
+        int64_t minimum_offset;
+        // Deltas between the last sample and the one before it
+        int64_t timestamp_delta;
+        int64_t offset_delta;
+        std::vector<uint8_t> data;
+    };
+
+    // Calls the callback with each of the block's samples, oldest first
+    template <typename Functor>
+    static void visit_samples(const Block& block, const Functor& callback);
+
+    size_t get_block_size() const;
+
+    std::deque<Block> blocks_;
+    size_t maximum_size_;
+    size_t size_{0};
+};
+
+} // pirulo
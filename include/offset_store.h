@@ -3,16 +3,27 @@
 #include <string>
 #include <cstdint>
 #include <unordered_map>
-#include <unordered_set>
 #include <map>
+#include <deque>
+#include <set>
 #include <mutex>
+#include <atomic>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <boost/optional.hpp>
 #include <cppkafka/topic_partition.h>
 #include "consumer_offset.h"
+#include "offset_history.h"
+#include "lag_rollups.h"
 #include "utils/async_observer.h"
 #include "utils/thread_pool.h"
+#include "utils/memory_usage.h"
+#include "utils/copy_on_write.h"
+#include "utils/string_interner.h"
 
 namespace pirulo {
 
@@ -27,44 +38,506 @@ public:
     using TopicMessageCallback = std::function<void(const std::string& topic,
                                                     int partition,
                                                     uint64_t offset)>;
+    using ConsumerCommitBatchCallback = std::function<void(const std::vector<ConsumerOffset>&)>;
+    using LagCallback = std::function<void(const std::string& group_id,
+                                           const std::string& topic, int partition,
+                                           int64_t consumer_offset, int64_t topic_offset,
+                                           int64_t lag)>;
+    // Every change to the store gets a new, increasing version
+    using Version = uint64_t;
+    using OffsetSamples = std::vector<OffsetHistory::Sample>;
+
+    // What the group metadata records say about a group. Groups whose metadata was never
+    // seen, e.g. the ones that commit offsets without joining the group, are UNKNOWN
+    enum class ConsumerGroupState {
+        UNKNOWN,
+        // The group has members
+        ACTIVE,
+        // No members, only its committed offsets are left
+        EMPTY,
+        // The group was deleted
+        DEAD
+    };
+
+    // A consumer offset commit or, if removed is set, the removal of one. The strings are
+    // owned by the caller so building these doesn't allocate
+    struct ConsumerOffsetUpdate {
+        const std::string& group_id;
+        const std::string& topic;
+        int partition;
+        int64_t offset;
+        bool removed;
+        // The __consumer_offsets partition this came from, -1 if unknown
+        int offsets_partition;
+        // When the commit happened in milliseconds since epoch, 0 if unknown
+        int64_t timestamp;
+    };
+
+    // The lag of many consumer offsets laid out as columns, one entry per offset. Group ids
+    // and topics are referenced by their index, only the ones with some offset are listed.
+    // Names point into the store's published views, which are kept alive along with them
+    struct LagColumns {
+        std::vector<const std::string*> group_ids;
+        std::vector<const std::string*> topics;
+        std::vector<std::shared_ptr<const void>> views;
+        std::vector<uint32_t> group_indexes;
+        std::vector<uint32_t> topic_indexes;
+        std::vector<int32_t> partitions;
+        std::vector<int64_t> consumer_offsets;
+        std::vector<int64_t> topic_offsets;
+        // Never negative, consumers can be ahead of a watermark that wasn't refreshed yet
+        std::vector<int64_t> lags;
+    };
+
+    // Everything that changed after some version
+    struct ChangeSet {
+        // The version to ask for changes since next time
+        Version version;
+        // If set, the changes asked for were too old to be known so everything in the store
+        // is included instead and removals may be missing. Anything built out of previous
+        // changes should be discarded
+        bool reset;
+        // A removed offset that was committed again shows up in both lists, so removals
+        // should be applied first
+        std::vector<ConsumerOffset> consumer_offsets;
+        std::vector<ConsumerOffset> removed_consumer_offsets;
+        std::vector<cppkafka::TopicPartition> topic_offsets;
+        // Topics removed along with all of their watermarks. Like offsets, these can show up
+        // in both lists if a topic was created again
+        std::vector<std::string> removed_topics;
+    };
 
     OffsetStore();
+    OffsetStore(const OffsetStore&) = delete;
+    OffsetStore& operator=(const OffsetStore&) = delete;
+    ~OffsetStore();
 
     void store_consumer_offset(const std::string& group_id, const std::string& topic,
                                int partition, uint64_t offset);
+    void remove_consumer_offset(const std::string& group_id, const std::string& topic,
+                                int partition);
+    // Applies all updates in order, locking each shard only once. Notifications are
+    // triggered after every update has been applied
+    void store_consumer_offsets(const std::vector<ConsumerOffsetUpdate>& updates);
+    void store_consumer_group_state(const std::string& group_id, ConsumerGroupState state);
     void store_topic_offset(const std::string& topic, int partition, uint64_t offset);
+    // Removes every offset of the groups that haven't committed in this long, as if they
+    // expired, and drops their commit callbacks. Groups that come back are announced as new
+    // again. Returns the removed groups
+    std::vector<std::string> remove_inactive_consumers(std::chrono::milliseconds ttl);
+    // Removes a deleted topic's watermarks, history and the offsets groups committed on it,
+    // and stops notifying its messages. Commits are held back while this runs
+    void remove_topic(const std::string& topic);
+    // Stores the timestamp, in milliseconds since epoch, of the message at some offset
+    void store_message_timestamp(const std::string& topic, int partition, int64_t offset,
+                                 int64_t timestamp);
+    // Keeps track of the next offset to be read on each __consumer_offsets partition, meaning
+    // every record before it is already reflected on this store
+    void set_consumer_offsets_position(int partition, int64_t offset);
+    // Marks a __consumer_offsets partition as fully loaded. The groups that live in it are
+    // considered ready from now on, meaning their offsets are exact and notifications for
+    // them are triggered
+    void set_consumer_offsets_partition_ready(int partition);
+    // Same as above, publishing the affected groups once for all of them
+    void set_consumer_offsets_partitions_ready(const std::vector<int>& partitions);
+    // Marks every group as ready
+    void set_consumer_offsets_loaded();
     void on_new_consumer(ConsumerCallback callback);
     void on_new_topic(TopicCallback callback);
-    void on_consumer_commit(const std::string& group_id, ConsumerCommitCallback callback);
+    // Callbacks are dropped when the group is evicted. Subscribing again with the same non null
+    // owner replaces that owner's callback instead of adding another one
+    void on_consumer_commit(const std::string& group_id, ConsumerCommitCallback callback,
+                            const void* owner = nullptr);
     void on_topic_message(const std::string& topic, TopicMessageCallback callback);
+    // Called once for every batch of commits applied through store_consumer_offsets
+    void on_consumer_commit_batch(ConsumerCommitBatchCallback callback);
 
     void enable_notifications();
+    // Consumer and topic offset queries are served from immutable copies of the store so
+    // they never block writers. Changes are published once every interval, 1 second by
+    // default, so these queries can lag behind writes by up to that much
+    void set_publish_interval(std::chrono::milliseconds interval);
+    // Makes every change so far visible to queries right away
+    void publish();
+    // Don't trigger commit notifications for groups that are known to have no members
+    void set_ignore_inactive_consumers(bool ignore);
+    // Keeps the history of every topic partition watermark and every consumer offset, using
+    // up to this many bytes for each of them. Watermarks are sampled whenever they're stored
+    // and consumer offsets whenever they're committed. History is disabled by default, this
+    // should be set before anything is stored
+    void set_history_size(size_t size);
+    // Caps the bytes used by the history of all topic partitions and groups together, 0
+    // meaning no cap, which is the default. Every series reserves the most it can use when
+    // it's created, so once the cap is reached new series aren't kept until others are
+    // removed. Should be set along with the history size
+    void set_maximum_history_size(size_t size);
+    // Keeps lag aggregates up to date, see get_consumer_lag. They're updated off the write
+    // path, on publishing, so they don't slow down writes but they do use memory for every
+    // offset. Disabled by default
+    void set_lag_rollups_enabled(bool enabled);
+    // Sampled message timestamps are cached per bucket of this many offsets, so groups at
+    // nearby offsets share them. 100 by default
+    void set_message_timestamp_bucket_size(int64_t size);
 
+    // Note that this includes groups that aren't ready yet
     std::vector<std::string> get_consumers() const;
+    // The __consumer_offsets partition the group lives in, if known
+    boost::optional<int> get_consumer_offsets_partition(const std::string& group_id) const;
+    // Timestamp in milliseconds of the group's latest commit, 0 if the group is unknown
+    int64_t get_consumer_commit_timestamp(const std::string& group_id) const;
+    bool is_consumer_ready(const std::string& group_id) const;
+    bool is_consumer_offsets_loaded() const;
+    ConsumerGroupState get_consumer_state(const std::string& group_id) const;
+    // Returns every group whose state is known
+    std::map<std::string, ConsumerGroupState> get_consumer_states() const;
+    // False iff the group is known to be empty or dead
+    bool is_consumer_active(const std::string& group_id) const;
+    // True iff inactive groups are ignored and this one is inactive. Anything computed out
+    // of commits, like lag, can skip these groups
+    bool is_consumer_ignored(const std::string& group_id) const;
+    std::set<int> get_ready_consumer_offsets_partitions() const;
     std::vector<ConsumerOffset> get_consumer_offsets(const std::string& group_id) const;
     boost::optional<int64_t> get_topic_offset(const std::string& topic,
                                               int partition) const;
     std::vector<std::string> get_topics() const;
+    // Returns every topic/partition along with its offset, sorted by topic and partition
+    std::vector<cppkafka::TopicPartition> get_topic_offsets() const;
+    // Groups that have offsets on this topic
+    std::vector<std::string> get_topic_consumers(const std::string& topic) const;
+    // Offsets of every group on this topic or on one of its partitions. These only look at
+    // the groups on the topic rather than every group
+    std::vector<ConsumerOffset> get_topic_consumer_offsets(const std::string& topic) const;
+    std::vector<ConsumerOffset> get_topic_consumer_offsets(const std::string& topic,
+                                                           int partition) const;
+    // Same as above but only for groups that are ready and aren't ignored. Both are checked
+    // on the published views, so this doesn't lock anything per group
+    std::vector<ConsumerOffset> get_ready_topic_consumer_offsets(const std::string& topic,
+                                                                 int partition) const;
+    std::map<int, int64_t> get_consumer_offsets_positions() const;
+    boost::optional<int64_t> get_consumer_offsets_position(int partition) const;
+    // Returns the consumer and topic offsets changed after the given version, as seen by
+    // queries. Use 0 to get everything. Group states aren't included
+    ChangeSet changes_since(Version version) const;
+    // Computes the lag of every consumer offset whose topic partition has a known watermark,
+    // as seen by queries. Ignored groups are left out, groups that aren't ready aren't.
+    // Views are walked once with no locking, so this is much cheaper than querying each group
+    LagColumns compute_all_lags() const;
+    // Same as above, but calls the callback for every offset rather than copying names
+    void visit_all_lags(const LagCallback& callback) const;
+    // Total lag of a group, of a group on a topic and of a topic, and a group's largest lag
+    // on a topic. These are only kept when lag rollups are enabled, otherwise they return
+    // none. They're updated from the published changes every time views are published, so
+    // reading them doesn't depend on how many groups there are
+    boost::optional<LagRollups::Rollup> get_consumer_lag(const std::string& group_id) const;
+    boost::optional<LagRollups::Rollup> get_consumer_lag(const std::string& group_id,
+                                                         const std::string& topic) const;
+    boost::optional<int64_t> get_consumer_max_lag(const std::string& group_id,
+                                                  const std::string& topic) const;
+    boost::optional<LagRollups::Rollup> get_topic_lag(const std::string& topic) const;
+    // The group partitions with the largest lag and the groups with the largest total lag,
+    // largest first. Groups known to have no members are left out. These don't scan the
+    // store either and are empty unless lag rollups are enabled
+    std::vector<LagRollups::PartitionLag> get_largest_partition_lags(size_t count) const;
+    std::vector<LagRollups::GroupLag> get_largest_consumer_lags(size_t count) const;
+    // Estimated memory used by each of the store's structures, including published views
+    // and observers
+    std::vector<MemoryUsage> get_memory_usage() const;
+    // The groups and topics using the most memory, largest first. Their entries are the
+    // amount of offsets and partitions they have
+    std::vector<MemoryUsage> get_largest_consumers(size_t count) const;
+    std::vector<MemoryUsage> get_largest_topics(size_t count) const;
+    // Watermark and consumer offset samples whose timestamps, in milliseconds since epoch,
+    // are within [start, end]. Empty if history is disabled
+    OffsetSamples get_topic_offset_history(const std::string& topic, int partition,
+                                           int64_t start, int64_t end) const;
+    OffsetSamples get_consumer_offset_history(const std::string& group_id,
+                                              const std::string& topic, int partition,
+                                              int64_t start, int64_t end) const;
+    // A stored message timestamp for an offset in the same bucket as this one, if any
+    boost::optional<int64_t> get_message_timestamp(const std::string& topic, int partition,
+                                                   int64_t offset) const;
+    // Estimates how long ago the partition's watermark was at this offset. Sampled message
+    // timestamps are used if there's one for the offset, otherwise its history is
+    // interpolated. Zero if the offset is at or past the latest watermark. None if there's
+    // no sample and history is disabled or doesn't go back far enough
+    boost::optional<std::chrono::milliseconds> get_time_lag(const std::string& topic,
+                                                            int partition,
+                                                            int64_t offset) const;
+    // Same as above using the group's committed offset
+    boost::optional<std::chrono::milliseconds> get_consumer_time_lag(const std::string& group_id,
+                                                                     const std::string& topic,
+                                                                     int partition) const;
 private:
     // Make sure tasks won't start piling up
     static constexpr size_t MAXIMUM_OBSERVER_TASKS = 10000;
+    // Amount of independently locked consumer group and topic shards
+    static constexpr size_t CONSUMER_SHARD_COUNT = 64;
+    static constexpr size_t TOPIC_SHARD_COUNT = 64;
+
+    // Topic watermarks are stored per partition, this marks the ones that are unknown
+    static constexpr int64_t NO_OFFSET = -1;
+    // Amount of removed consumer offsets each shard remembers for change sets
+    static constexpr size_t MAXIMUM_REMOVED_OFFSETS = 4096;
+    // Amount of published generations and changed ids each shard remembers for change sets
+    static constexpr size_t MAXIMUM_CHANGE_BATCHES = 256;
+    static constexpr size_t MAXIMUM_CHANGED_IDS = 65536;
+    // Amount of message timestamp buckets kept per partition. Groups move forward so the
+    // lowest buckets are dropped first
+    static constexpr size_t MAXIMUM_TIMESTAMP_BUCKETS = 64;
+
+    // Topic ids are dense indexes into a shard's topic names
+    using TopicId = uint32_t;
+    // Groups are dense indexes into a shard's groups
+    using GroupId = uint32_t;
+
+    struct PartitionOffset {
+        TopicId topic_id;
+        int32_t partition;
+        int64_t offset;
+        Version version;
+
+        bool operator<(const PartitionOffset& rhs) const;
+    };
+
+    struct ConsumerGroup {
+        std::string group_id;
+        // Sorted by topic id and partition
+        std::vector<PartitionOffset> offsets;
+        // The __consumer_offsets partition the group's commits are written to
+        int offsets_partition{-1};
+        // Latest version any of its offsets was changed at
+        Version version{0};
+        // Latest commit time in milliseconds since epoch
+        int64_t commit_timestamp{0};
+        // False iff the group is known to be empty or dead
+        bool is_active{true};
+    };
+
+    struct RemovedTopic {
+        std::string topic;
+        Version version;
+    };
+
+    struct RemovedOffset {
+        std::string group_id;
+        TopicId topic_id;
+        int32_t partition;
+        Version version;
+    };
+
+    // What changed on a published generation. Every change in it happened after the previous
+    // batch's version and up to this one's
+    template <typename T>
+    struct ChangeBatch {
+        Version version;
+        std::shared_ptr<const std::vector<T>> ids;
+    };
+    template <typename T>
+    using ChangeLog = CopyOnWrite<std::deque<ChangeBatch<T>>>;
+    // Group states are kept apart as metadata and offsets come and go independently
+    using ConsumerStateMap = std::unordered_map<std::string, ConsumerGroupState>;
+    // History isn't published to readers as copying it every time would be too expensive
+    using PartitionHistoryMap = std::map<std::pair<TopicId, int32_t>, OffsetHistory>;
+    using ConsumerHistoryMap = std::unordered_map<std::string, PartitionHistoryMap>;
+    using TopicHistoryMap = std::unordered_map<std::string, std::map<int32_t, OffsetHistory>>;
+    // Sampled message timestamps per partition and offset bucket
+    using TimestampBucketMap = std::map<int64_t, int64_t>;
+    using MessageTimestampMap = std::unordered_map<std::string,
+                                                   std::map<int32_t, TimestampBucketMap>>;
+
+    // Published views share everything with the shard but the tables pointing to it, see
+    // CopyOnWrite. Views are published once per generation
+    using Generation = CopyOnWrite<ConsumerGroup>::Generation;
+
+    // The part of a consumer shard that's published to readers
+    struct ConsumerShardData {
+        std::vector<CopyOnWrite<ConsumerGroup>> groups;
+        CopyOnWrite<std::unordered_map<std::string, GroupId>> group_ids;
+        // Ids are reused once no offset or removal references them. Their names are null
+        // while they're free. Names are shared by every shard and view, ids are keyed by
+        // views into them
+        CopyOnWrite<std::vector<SharedStringInterner::StringPtr>> topic_names;
+        CopyOnWrite<std::unordered_map<boost::string_ref, TopicId,
+                                       StringViewHasher>> topic_ids;
+        // Latest removals, oldest first. Any removal up to the horizon may have been dropped
+        CopyOnWrite<std::deque<RemovedOffset>> removed_offsets;
+        Version removal_horizon{0};
+        // Ids of the groups changed on each generation, oldest first, so change sets don't
+        // look at every group. Ids are the ones groups had back then, a group moved to another
+        // id is logged again. Changes up to the horizon may be missing
+        ChangeLog<GroupId> changed_groups;
+        Version change_horizon{0};
+
+        const ConsumerGroup* find_group(const std::string& group_id) const;
+        const TopicId* find_topic_id(const std::string& topic) const;
+        const std::string& get_topic_name(TopicId id) const;
+    };
+
+    // Groups are spread among shards so concurrent writers rarely touch the same lock
+    struct ConsumerShard : ConsumerShardData {
+        ConsumerStateMap consumer_states;
+        // Groups that became active or inactive since the lag rollups last saw them
+        std::vector<std::string> changed_states;
+        // Groups changed since the view was published
+        std::vector<GroupId> pending_changed_groups;
+        ConsumerHistoryMap consumer_histories;
+        // Latest published copy. Only replaced while holding the mutex, so versions are
+        // always published in order
+        std::shared_ptr<const ConsumerShardData> view;
+        // Every change up to this version is in the view
+        std::atomic<Version> view_version{0};
+        // Offsets and removals referencing each topic id
+        std::vector<uint32_t> topic_references;
+        std::vector<TopicId> free_topic_ids;
+        Generation generation{0};
+        bool dirty{false};
+        mutable std::mutex mutex;
+
+        ConsumerGroup& get_mutable_group(GroupId id);
+        // Finds or allocates an id. It's freed once every reference added to it is removed
+        TopicId get_topic_id(const std::string& topic, SharedStringInterner& interner);
+        void add_topic_reference(TopicId id);
+        void remove_topic_reference(TopicId id);
+        // Removes a group by moving the last one into its place
+        void remove_group(GroupId id);
+    };
+
+    struct TopicOffsets {
+        // Watermarks and the version they last changed at, indexed by partition
+        std::vector<int64_t> offsets;
+        std::vector<Version> versions;
+        // Latest version any partition changed at
+        Version version{0};
+    };
+    using TopicMap = std::unordered_map<std::string, CopyOnWrite<TopicOffsets>>;
+    // Groups with offsets on each topic, along with how many of its partitions they have
+    using ConsumerCountMap = std::unordered_map<std::string, uint32_t>;
+    using TopicConsumerMap = std::unordered_map<std::string, CopyOnWrite<ConsumerCountMap>>;
+
+    // The part of a topic shard that's published to readers
+    struct TopicShardData {
+        TopicMap topic_offsets;
+        TopicConsumerMap topic_consumers;
+        // Same as a consumer shard's removed offsets and changed groups
+        CopyOnWrite<std::deque<RemovedTopic>> removed_topics;
+        Version removal_horizon{0};
+        ChangeLog<std::string> changed_topics;
+        Version change_horizon{0};
+    };
+
+    // Topics are sharded by name, so all partitions of a topic live in the same shard
+    struct TopicShard : TopicShardData {
+        TopicHistoryMap topic_histories;
+        MessageTimestampMap message_timestamps;
+        std::vector<std::string> pending_changed_topics;
+        std::shared_ptr<const TopicShardData> view;
+        std::atomic<Version> view_version{0};
+        Generation generation{0};
+        bool dirty{false};
+        mutable std::mutex mutex;
+    };
+
+    // Lags of a consumer shard's offsets as columns. Group indexes point into the view's groups
+    struct ShardLags {
+        std::vector<GroupId> group_indexes;
+        std::vector<TopicId> topic_ids;
+        std::vector<int32_t> partitions;
+        std::vector<int64_t> consumer_offsets;
+        std::vector<int64_t> topic_offsets;
+        std::vector<int64_t> lags;
+
+        void clear();
+    };
 
-    using TopicMap = std::map<cppkafka::TopicPartition, int64_t>;
-    using ConsumerMap = std::unordered_map<std::string, TopicMap>;
-    using StringSet = std::unordered_set<std::string>;
+    // Returns true iff this created a new consumer group. Topic shards are locked while
+    // holding the consumer shard lock, never the other way around
+    bool apply_update(ConsumerShard& shard, const ConsumerOffsetUpdate& update,
+                      Version version);
+    // Removes every offset a group has on a topic, or on every topic if it's null. The group
+    // id can't be owned by the shard, as removing its last offset removes the group
+    void remove_consumer_offsets(ConsumerShard& shard, const std::string& group_id,
+                                 const std::string* topic);
+    void add_topic_consumer(const std::string& topic, const std::string& group_id);
+    void remove_topic_consumer(const std::string& topic, const std::string& group_id);
+    // Calls the callback with each group on the topic and each of its offsets on it
+    template <typename Functor>
+    void visit_topic_consumer_offsets(const std::string& topic, const Functor& callback) const;
+    // Calls the callback with each consumer shard's view and the lags of the offsets of the
+    // groups that aren't ignored
+    template <typename Functor>
+    void visit_shard_lags(const Functor& callback) const;
+    // Must be called while holding the shard's lock
+    boost::optional<int64_t> find_message_timestamp(const TopicShard& shard,
+                                                    const std::string& topic, int partition,
+                                                    int64_t offset) const;
+    static size_t get_consumer_size(const ConsumerGroup& group);
+    static size_t get_topic_size(const TopicShard& shard, const std::string& topic);
+    static void add_memory_usage(const ConsumerShardData& data,
+                                 std::vector<MemoryUsage>& output);
+    static void add_memory_usage(const TopicShardData& data, std::vector<MemoryUsage>& output);
+    // Must be called while holding the lag rollups mutex
+    void reset_lag_rollups();
+    void update_lag_rollups();
+    // Must be called while holding the shard's lock, before the state changes. Keeps the
+    // group's activeness and the lag rollups up to date
+    void on_consumer_state_change(ConsumerShard& shard, const std::string& group_id,
+                                  ConsumerGroupState new_state);
+    void publish_shard(ConsumerShard& shard);
+    void publish_shard(TopicShard& shard);
+    // Moves the ids changed on a generation into the log, dropping the oldest batches if
+    // it's too large
+    template <typename T>
+    static void log_changes(ChangeLog<T>& log, Version& horizon, std::vector<T>& pending,
+                            Version version, Generation generation);
+    static std::shared_ptr<const ConsumerShardData> get_view(const ConsumerShard& shard);
+    static std::shared_ptr<const TopicShardData> get_view(const TopicShard& shard);
+    static bool is_active_state(ConsumerGroupState state);
+    bool is_consumer_ignored(const ConsumerShard& shard, const std::string& group_id) const;
+    size_t get_consumer_shard_index(const std::string& group_id) const;
+    ConsumerShard& get_consumer_shard(const std::string& group_id);
+    bool is_partition_ready(const std::set<int>& ready_partitions, int partition) const;
+    bool is_partition_ready(int partition) const;
+    // Reserves the bytes a new history series can use, returns false if the cap is reached
+    bool reserve_history(const OffsetHistory& history);
+    void release_history(const OffsetHistory& history);
+    const ConsumerShard& get_consumer_shard(const std::string& group_id) const;
+    TopicShard& get_topic_shard(const std::string& topic);
+    const TopicShard& get_topic_shard(const std::string& topic) const;
+    void run_publisher();
 
-    ConsumerMap consumer_offsets_;
-    TopicMap topic_offsets_;
-    StringSet consumers_;
-    StringSet topics_;
+    // A topic's name is stored once no matter how many shards have offsets on it
+    SharedStringInterner topic_names_;
+    std::vector<ConsumerShard> consumer_shards_;
+    std::vector<TopicShard> topic_shards_;
+    // Only updated while holding the lag rollups mutex, which never waits on shard locks
+    LagRollups lag_rollups_;
+    Version lag_rollups_version_{0};
+    std::atomic<bool> lag_rollups_enabled_{false};
+    std::mutex lag_rollups_mutex_;
+    std::map<int, int64_t> consumer_offsets_positions_;
+    std::set<int> ready_partitions_;
     ThreadPool thread_pool_{1, MAXIMUM_OBSERVER_TASKS};
     AsyncObserver<int, std::string> new_string_observer_;
     AsyncObserver<std::string, std::string, int, uint64_t> consumer_commit_observer_;
     AsyncObserver<std::string, int, uint64_t> topic_message_observer_; 
+    AsyncObserver<int, std::vector<ConsumerOffset>> commit_batch_observer_;
     std::string new_consumer_id_;
-    mutable std::mutex consumer_offsets_mutex_;
-    mutable std::mutex topic_offsets_mutex_;
-    bool notifications_enabled_{false};
+    mutable std::mutex positions_mutex_;
+    std::atomic<bool> notifications_enabled_{false};
+    std::atomic<bool> consumer_offsets_loaded_{false};
+    std::atomic<bool> ignore_inactive_consumers_{false};
+    std::atomic<size_t> history_size_{0};
+    std::atomic<size_t> maximum_history_size_{0};
+    std::atomic<size_t> reserved_history_size_{0};
+    std::atomic<size_t> history_series_count_{0};
+    std::atomic<int64_t> timestamp_bucket_size_{100};
+    // Only incremented while holding the lock of the shard being changed
+    std::atomic<Version> version_;
+    std::chrono::milliseconds publish_interval_{std::chrono::seconds(1)};
+    std::mutex publisher_mutex_;
+    std::condition_variable publisher_condition_;
+    bool publisher_running_{true};
+    std::thread publisher_thread_;
 };
 
 } // pirulo
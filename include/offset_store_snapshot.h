@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include "offset_store.h"
+
+namespace pirulo {
+
+// Persists the contents of an OffsetStore into a file, along with the __consumer_offsets
+// positions it reflects, so a restart only needs to replay what came after them.
+//
+// Snapshots are written into a temporary file which is synced and then renamed, syncing the
+// directory afterwards, so a crash never leaves a broken or empty snapshot behind. They are
+// read by memory mapping them.
+class OffsetStoreSnapshot {
+public:
+    OffsetStoreSnapshot(std::string path);
+
+    // Publishes the store's pending changes so the snapshot includes them
+    void save(OffsetStore& store) const;
+    // Returns false if there's no snapshot to load
+    bool load(OffsetStore& store) const;
+
+    const std::string& get_path() const;
+private:
+    std::string path_;
+};
+
+} // pirulo
@@ -1,8 +1,6 @@
 #pragma once
 
-#include <tuple>
-#include <map>
-#include <unordered_map>
+#include <chrono>
 #include "python/handler.h"
 
 namespace pirulo {
@@ -14,6 +12,11 @@ public:
 protected:
     virtual void handle_lag_update(const std::string& topic, int partition,
                                    const std::string& group_id, uint64_t consumer_lag) { }
+    // Called after a lag update if the store's history can tell how far behind in time the
+    // group is (see OffsetStore::get_time_lag)
+    virtual void handle_time_lag_update(const std::string& topic, int partition,
+                                        const std::string& group_id,
+                                        std::chrono::milliseconds time_lag) { }
 
     void handle_initialize() override;
     void handle_new_consumer(const std::string& group_id) override;
@@ -23,14 +26,8 @@ protected:
     void handle_topic_message(const std::string& topic, int partition,
                               int64_t offset) override;
 private:
-    struct TopicPartitionInfo {
-        int64_t offset{-1};
-        std::unordered_map<std::string, int64_t> consumer_offsets;
-    };
-    using TopicPartitionId = std::tuple<std::string, int>;
-    using TopicPartitionInfoMap = std::map<TopicPartitionId, TopicPartitionInfo>;
-
-    TopicPartitionInfoMap topic_partition_info_;
+    void update_lag(const std::string& topic, int partition, const std::string& group_id,
+                    int64_t committed_offset, int64_t topic_offset);
 };
 
 } // api
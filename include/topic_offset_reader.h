@@ -2,6 +2,7 @@
 
 #include <mutex>
 #include <set>
+#include <memory>
 #include <chrono>
 #include <cppkafka/consumer.h>
 #include "utils/thread_pool.h"
@@ -24,31 +25,67 @@ public:
     void run();
     void stop();
 
+    // Fetches the timestamps of the messages at the offsets groups committed so time lags
+    // are exact rather than interpolated (see OffsetStore::get_time_lag). Groups whose
+    // offsets are in the same bucket share a fetch, and at most this many are done per
+    // second. Fetches are done by a consumer and thread of their own so they never hold back
+    // watermark refreshes. Disabled by default, this should be set before calling run
+    void enable_timestamp_sampling(double maximum_fetches_per_second);
+    // Topics missing from the metadata for this long are considered deleted. They stop being
+    // refreshed and are removed from the store. 10 minutes by default
+    void set_deleted_topic_ttl(std::chrono::seconds ttl);
+
     StorePtr get_store() const;
+    // Estimated memory used by the refresh tasks and the partitions being monitored
+    std::vector<MemoryUsage> get_memory_usage() const;
 private:
     using TopicPartitionCount = std::unordered_map<std::string, size_t>;
     using MetadataCallback = std::function<void(TopicPartitionCount)>;
     using TopicTaskIdMap = std::map<cppkafka::TopicPartition, TaskScheduler::TaskId>;
+    using MissingTopicMap = std::unordered_map<std::string,
+                                               std::chrono::steady_clock::time_point>;
 
     void async_process_topics(const TopicPartitionCount& topics);
     void monitor_topics(const TopicPartitionCount& topics);
     void monitor_topics(const cppkafka::TopicPartitionList& topics);
     void monitor_new_topics();
     cppkafka::TopicPartitionList get_new_topic_partitions(const TopicPartitionCount& counts);
+    void remove_deleted_topics(const TopicPartitionCount& counts);
     TopicPartitionCount load_metadata();
     void process_metadata(const MetadataCallback& callback);
     void process_topic_partition(const cppkafka::TopicPartition& topic_partition);
+    // Queues the fetches of the timestamps of the partition's committed offsets
+    void sample_message_timestamps(const cppkafka::TopicPartition& topic_partition,
+                                   int64_t topic_offset);
+    void fetch_message_timestamps(const cppkafka::TopicPartition& topic_partition,
+                                  const std::set<int64_t>& offsets);
+    // Fetches the timestamp of the message at the topic partition's offset and stores it
+    void fetch_message_timestamp(const cppkafka::TopicPartition& message);
+    bool acquire_fetch();
     void on_commit(const std::string& topic, int partition);
 
     ConsumerPool consumer_pool_;
+    cppkafka::Configuration timestamp_config_;
     StorePtr store_;
     ThreadPool thread_pool_;
     TaskScheduler task_scheduler_;
     ConsumerOffsetReaderPtr consumer_offset_reader_;
     TopicTaskIdMap monitored_topic_task_id_;
+    // When each monitored topic was first found missing from the metadata
+    MissingTopicMap missing_topics_;
+    mutable std::mutex monitored_topics_mutex_;
+    std::chrono::seconds deleted_topic_ttl_{600};
     std::chrono::seconds maximum_topic_reload_time_{100};
     std::chrono::seconds maximum_metadata_reload_time_{100};
     bool running_{true};
+    // Fetch budget, refilled at the maximum rate and capped at about one second's worth
+    double maximum_fetches_per_second_{0};
+    double available_fetches_{0};
+    std::chrono::steady_clock::time_point last_fetch_refill_;
+    std::mutex fetch_budget_mutex_;
+    // Only used by the timestamp thread, which has to be stopped before it's destroyed
+    std::unique_ptr<cppkafka::Consumer> timestamp_consumer_;
+    ThreadPool timestamp_thread_;
 };
 
 } // pirulo
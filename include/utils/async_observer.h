@@ -13,8 +13,12 @@ public:
     AsyncObserver(ThreadPool& pool);
     AsyncObserver(ThreadPool& pool, std::chrono::milliseconds cool_down_time);
 
-    void observe(const T& object, const ObserverCallback& callback);
+    void observe(const T& object, const ObserverCallback& callback,
+                 const void* owner = nullptr);
+    void unobserve(const T& object);
     void notify(const T& object, const Args&... args);
+    size_t get_observed_count() const;
+    size_t get_memory_usage() const;
 private:
     Observer<T, Args...> observer_;
     ThreadPool& pool_;
@@ -34,13 +38,19 @@ AsyncObserver<T, Args...>::AsyncObserver(ThreadPool& pool,
 }
 
 template <typename T, typename... Args>
-void AsyncObserver<T, Args...>::observe(const T& object, const ObserverCallback& callback) {
+void AsyncObserver<T, Args...>::observe(const T& object, const ObserverCallback& callback,
+                                        const void* owner) {
     observer_.observe(object, [&, callback](const T& object, const Args&... args) {
         auto wrapped_callback = std::bind(callback, object, args...);
         pool_.add_task([wrapped_callback]() {
             wrapped_callback();
         });
-    });
+    }, owner);
+}
+
+template <typename T, typename... Args>
+void AsyncObserver<T, Args...>::unobserve(const T& object) {
+    observer_.unobserve(object);
 }
 
 template <typename T, typename... Args>
@@ -48,4 +58,14 @@ void AsyncObserver<T, Args...>::notify(const T& object, const Args&... args) {
     observer_.notify(object, args...);
 }
 
+template <typename T, typename... Args>
+size_t AsyncObserver<T, Args...>::get_observed_count() const {
+    return observer_.get_observed_count();
+}
+
+template <typename T, typename... Args>
+size_t AsyncObserver<T, Args...>::get_memory_usage() const {
+    return observer_.get_memory_usage();
+}
+
 } // pirulo
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+
+namespace pirulo {
+
+// Value that can be shared with read only copies of the structure it's part of. The first
+// change after sharing it copies it, so copying the structure only copies pointers and each
+// change only copies what it touches.
+//
+// Values are shared in generations: the owner bumps its generation whenever it hands out a
+// copy, and values last copied in an older one may be referenced by it. This way sharing
+// doesn't need to touch every value.
+//
+// This class is not thread safe. Copies of it must only be read.
+template <typename T>
+class CopyOnWrite {
+public:
+    using Generation = uint64_t;
+
+    CopyOnWrite();
+    CopyOnWrite(T value, Generation generation);
+
+    const T& operator*() const;
+    const T* operator->() const;
+    // Returns a value that's not shared with anything handed out before this generation
+    T& get_mutable(Generation generation);
+private:
+    std::shared_ptr<T> value_;
+    Generation generation_{0};
+};
+
+template <typename T>
+CopyOnWrite<T>::CopyOnWrite()
+: value_(std::make_shared<T>()) {
+
+}
+
+template <typename T>
+CopyOnWrite<T>::CopyOnWrite(T value, Generation generation)
+: value_(std::make_shared<T>(std::move(value))), generation_(generation) {
+
+}
+
+template <typename T>
+const T& CopyOnWrite<T>::operator*() const {
+    return *value_;
+}
+
+template <typename T>
+const T* CopyOnWrite<T>::operator->() const {
+    return value_.get();
+}
+
+template <typename T>
+T& CopyOnWrite<T>::get_mutable(Generation generation) {
+    if (generation_ != generation) {
+        value_ = std::make_shared<T>(*value_);
+        generation_ = generation;
+    }
+    return *value_;
+}
+
+} // pirulo
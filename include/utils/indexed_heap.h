@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <limits>
+#include <utility>
+#include <cstddef>
+
+namespace pirulo {
+
+// Max heap of pointers to elements that keep track of where they are in it, so any element
+// can be added, moved after its key changed or removed in O(log n) without allocating.
+//
+// Keys are stored next to the pointers so moving things around doesn't touch the elements
+// other than to update their position. Elements need a size_t heap_index member initialized
+// to NOT_IN_HEAP, so an element can only be in one heap per index member.
+//
+// This class is not thread safe.
+template <typename T, typename Key>
+class IndexedHeap {
+public:
+    static constexpr size_t NOT_IN_HEAP = std::numeric_limits<size_t>::max();
+
+    // Adds the element if it's not in the heap, otherwise moves it to its new place
+    void update(T* element, const Key& key);
+    // Does nothing if the element isn't in the heap
+    void remove(T* element);
+    // The count elements with the largest keys, largest first. This takes O(count log count)
+    std::vector<T*> get_largest(size_t count) const;
+    size_t size() const;
+    // Estimated bytes used on top of the heap's own size
+    size_t get_memory_usage() const;
+private:
+    using Entry = std::pair<Key, T*>;
+
+    void move_to(const Entry& entry, size_t index);
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+
+    std::vector<Entry> entries_;
+};
+
+template <typename T, typename Key>
+constexpr size_t IndexedHeap<T, Key>::NOT_IN_HEAP;
+
+template <typename T, typename Key>
+void IndexedHeap<T, Key>::update(T* element, const Key& key) {
+    if (element->heap_index == NOT_IN_HEAP) {
+        entries_.emplace_back(key, element);
+        element->heap_index = entries_.size() - 1;
+        sift_up(element->heap_index);
+        return;
+    }
+    const size_t index = element->heap_index;
+    const bool is_larger = entries_[index].first < key;
+    entries_[index].first = key;
+    if (is_larger) {
+        sift_up(index);
+    }
+    else {
+        sift_down(index);
+    }
+}
+
+template <typename T, typename Key>
+void IndexedHeap<T, Key>::remove(T* element) {
+    const size_t index = element->heap_index;
+    if (index == NOT_IN_HEAP) {
+        return;
+    }
+    element->heap_index = NOT_IN_HEAP;
+    const Entry last = entries_.back();
+    entries_.pop_back();
+    if (last.second == element) {
+        return;
+    }
+    // Put the last one in its place and fix wherever it ends up being out of order
+    move_to(last, index);
+    sift_up(index);
+    if (last.second->heap_index == index) {
+        sift_down(index);
+    }
+}
+
+template <typename T, typename Key>
+std::vector<T*> IndexedHeap<T, Key>::get_largest(size_t count) const {
+    // Go down the heap keeping the candidates in a second heap. The next largest is always
+    // one of the children of the ones already taken
+    auto candidate_compare = [&](size_t lhs, size_t rhs) {
+        return entries_[lhs].first < entries_[rhs].first;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(candidate_compare)>
+        candidates(candidate_compare);
+    std::vector<T*> output;
+    if (!entries_.empty()) {
+        candidates.push(0);
+    }
+    while (output.size() < count && !candidates.empty()) {
+        const size_t index = candidates.top();
+        candidates.pop();
+        output.push_back(entries_[index].second);
+        for (size_t child = index * 2 + 1; child <= index * 2 + 2; ++child) {
+            if (child < entries_.size()) {
+                candidates.push(child);
+            }
+        }
+    }
+    return output;
+}
+
+template <typename T, typename Key>
+size_t IndexedHeap<T, Key>::size() const {
+    return entries_.size();
+}
+
+template <typename T, typename Key>
+size_t IndexedHeap<T, Key>::get_memory_usage() const {
+    return entries_.capacity() * sizeof(Entry);
+}
+
+template <typename T, typename Key>
+void IndexedHeap<T, Key>::move_to(const Entry& entry, size_t index) {
+    entries_[index] = entry;
+    entry.second->heap_index = index;
+}
+
+template <typename T, typename Key>
+void IndexedHeap<T, Key>::sift_up(size_t index) {
+    const Entry entry = entries_[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / 2;
+        if (!(entries_[parent].first < entry.first)) {
+            break;
+        }
+        move_to(entries_[parent], index);
+        index = parent;
+    }
+    move_to(entry, index);
+}
+
+template <typename T, typename Key>
+void IndexedHeap<T, Key>::sift_down(size_t index) {
+    const Entry entry = entries_[index];
+    while (true) {
+        size_t child = index * 2 + 1;
+        if (child >= entries_.size()) {
+            break;
+        }
+        if (child + 1 < entries_.size() && entries_[child].first < entries_[child + 1].first) {
+            child++;
+        }
+        if (!(entry.first < entries_[child].first)) {
+            break;
+        }
+        move_to(entries_[child], index);
+        index = child;
+    }
+    move_to(entry, index);
+}
+
+} // pirulo
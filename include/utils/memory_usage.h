@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <cppkafka/topic_partition.h>
+
+namespace pirulo {
+
+// Estimated memory used by some structure
+struct MemoryUsage {
+    std::string name;
+    size_t entries;
+    // Includes whatever the entries allocate
+    size_t bytes;
+
+    bool operator==(const MemoryUsage& rhs) const;
+};
+
+// Estimates of the heap memory objects use on top of their own size. These follow the way
+// common standard libraries lay things out, they're meant for capacity planning rather than
+// being exact. Containers only account for their own storage, not what their elements
+// allocate
+namespace memory {
+
+// Overhead of each node in a map/set (3 pointers plus the color) and in a hash table (next
+// pointer plus cached hash)
+constexpr size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+constexpr size_t HASH_NODE_OVERHEAD = 2 * sizeof(void*);
+
+// Zero if it fits in the small string buffer
+size_t get_heap_size(const std::string& value);
+size_t get_heap_size(const cppkafka::TopicPartition& value);
+
+// Anything else is assumed not to use the heap
+template <typename T>
+size_t get_heap_size(const T&) {
+    return 0;
+}
+
+template <typename T>
+size_t get_heap_size(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+template <typename T>
+size_t get_heap_size(const std::deque<T>& values) {
+    return values.size() * sizeof(T);
+}
+
+template <typename K, typename V, typename C>
+size_t get_heap_size(const std::map<K, V, C>& values) {
+    using ValueType = typename std::map<K, V, C>::value_type;
+    return values.size() * (sizeof(ValueType) + TREE_NODE_OVERHEAD);
+}
+
+template <typename K, typename V, typename H, typename E>
+size_t get_heap_size(const std::unordered_map<K, V, H, E>& values) {
+    using ValueType = typename std::unordered_map<K, V, H, E>::value_type;
+    return values.size() * (sizeof(ValueType) + HASH_NODE_OVERHEAD) +
+           values.bucket_count() * sizeof(void*);
+}
+
+template <typename T, typename H, typename E>
+size_t get_heap_size(const std::unordered_set<T, H, E>& values) {
+    return values.size() * (sizeof(T) + HASH_NODE_OVERHEAD) +
+           values.bucket_count() * sizeof(void*);
+}
+
+} // memory
+} // pirulo
@@ -4,6 +4,8 @@
 #include <chrono>
 #include <functional>
 #include <mutex>
+#include <vector>
+#include "utils/memory_usage.h"
 
 namespace pirulo {
 
@@ -15,13 +17,22 @@ public:
     Observer();
     Observer(std::chrono::milliseconds cool_down_time);
 
-    void observe(const T& object, ObserverCallback callback);
+    // A non null owner makes the call idempotent: it replaces the callback that owner registered
+    // before for this object, if any
+    void observe(const T& object, ObserverCallback callback, const void* owner = nullptr);
+    // Removes every callback observing this object
+    void unobserve(const T& object);
     void notify(const T& object, const Args&... args);
+    // Amount of observed objects and the estimated bytes used to keep track of them. Callbacks
+    // are counted by their own size, whatever they capture isn't
+    size_t get_observed_count() const;
+    size_t get_memory_usage() const;
 
 private:
     using ClockType = std::chrono::steady_clock;
     struct ObservedContext {
         std::vector<ObserverCallback> observers;
+        std::vector<const void*> owners;
         ClockType::time_point last_observe_time;
     };
     using ObservedObjectsMap = std::map<T, ObservedContext>;
@@ -44,9 +55,26 @@ Observer<T, Args...>::Observer(std::chrono::milliseconds cool_down_time)
 }
 
 template <typename T, typename... Args>
-void Observer<T, Args...>::observe(const T& object, ObserverCallback callback) {
+void Observer<T, Args...>::observe(const T& object, ObserverCallback callback,
+                                   const void* owner) {
     std::lock_guard<std::mutex> _(observed_objects_mutex_);
-    observed_objects_[object].observers.emplace_back(std::move(callback));
+    ObservedContext& context = observed_objects_[object];
+    if (owner) {
+        for (size_t i = 0; i < context.owners.size(); ++i) {
+            if (context.owners[i] == owner) {
+                context.observers[i] = std::move(callback);
+                return;
+            }
+        }
+    }
+    context.observers.emplace_back(std::move(callback));
+    context.owners.emplace_back(owner);
+}
+
+template <typename T, typename... Args>
+void Observer<T, Args...>::unobserve(const T& object) {
+    std::lock_guard<std::mutex> _(observed_objects_mutex_);
+    observed_objects_.erase(object);
 }
 
 template <typename T, typename... Args>
@@ -72,4 +100,22 @@ void Observer<T, Args...>::notify(const T& object, const Args&... args) {
     }
 }
 
+template <typename T, typename... Args>
+size_t Observer<T, Args...>::get_observed_count() const {
+    std::lock_guard<std::mutex> _(observed_objects_mutex_);
+    return observed_objects_.size();
+}
+
+template <typename T, typename... Args>
+size_t Observer<T, Args...>::get_memory_usage() const {
+    std::lock_guard<std::mutex> _(observed_objects_mutex_);
+    size_t output = memory::get_heap_size(observed_objects_);
+    for (const auto& object_pair : observed_objects_) {
+        output += memory::get_heap_size(object_pair.first) +
+                  memory::get_heap_size(object_pair.second.observers) +
+                  memory::get_heap_size(object_pair.second.owners);
+    }
+    return output;
+}
+
 } // pirulo
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <boost/utility/string_ref.hpp>
+
+namespace pirulo {
+
+struct StringViewHasher {
+    size_t operator()(boost::string_ref value) const;
+};
+
+// Keeps a single copy of every string it's given. Lookups are done through views so
+// interning a string that was already seen doesn't allocate.
+//
+// This class is not thread safe.
+class StringInterner {
+public:
+    // Returns a reference to the interned copy of the given string. The reference is valid
+    // until clear is called or this object is destroyed
+    const std::string& intern(boost::string_ref value);
+    void clear();
+    size_t size() const;
+private:
+    using IndexMap = std::unordered_map<boost::string_ref, const std::string*,
+                                        StringViewHasher>;
+
+    // A deque never relocates its elements, so views into them stay valid
+    std::deque<std::string> strings_;
+    IndexMap indexes_;
+};
+
+// Same as StringInterner, but strings are reference counted and each one is freed once the
+// last reference to it goes away. Interning a string that's still referenced returns the
+// same copy, so any amount of owners can share them.
+//
+// This class is thread safe. The strings can outlive it.
+class SharedStringInterner {
+public:
+    using StringPtr = std::shared_ptr<const std::string>;
+
+    SharedStringInterner();
+
+    StringPtr intern(boost::string_ref value);
+    // Amount of strings and bytes used by them
+    size_t size() const;
+    size_t get_memory_usage() const;
+private:
+    // Strings point to this rather than to the interner so they can be released after it's
+    // gone
+    struct State {
+        using IndexMap = std::unordered_map<boost::string_ref, std::weak_ptr<const std::string>,
+                                            StringViewHasher>;
+
+        void release(const std::string* value);
+
+        IndexMap indexes;
+        size_t string_bytes{0};
+        mutable std::mutex mutex;
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+} // pirulo
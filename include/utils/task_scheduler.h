@@ -26,6 +26,9 @@ public:
     void remove_task(TaskId id);
     void set_priority(TaskId id, double priority);
     void set_minimum_reschedule_time(Duration value);
+    size_t get_task_count() const;
+    // Estimated bytes used to keep track of tasks, not counting what they capture
+    size_t get_memory_usage() const;
 
 private:
     using ClockType = std::chrono::steady_clock;
@@ -6,6 +6,10 @@ namespace pirulo {
 namespace utils {
 
 std::string generate_group_id();
+// Returns the __consumer_offsets partition the given group's commits are written to. This
+// matches the broker's logic, which hashes the group id using Java's String.hashCode. Throws
+// if the partition count isn't positive
+int get_group_offsets_partition(const std::string& group_id, int partition_count);
 
 } // utils
 } // pirulo
@@ -7,5 +7,9 @@ class Plugin(LagTrackerHandler):
     def handle_lag_update(self, topic, partition, group_id, lag):
         print 'Consumer {0} has {1} lag on {2}/{3}'.format(group_id, lag, topic, partition)
 
+    def handle_time_lag_update(self, topic, partition, group_id, time_lag):
+        print 'Consumer {0} is {1}ms behind on {2}/{3}'.format(group_id, time_lag, topic,
+                                                              partition)
+
 def create_plugin():
     return Plugin()
@@ -2,15 +2,24 @@
 #include <vector>
 #include <cassert>
 #include "application.h"
+#include "exceptions.h"
 #include "detail/logging.h"
 
 using std::thread;
 using std::vector;
+using std::string;
+using std::move;
+
+using std::chrono::seconds;
 
 namespace pirulo {
 
 PIRULO_CREATE_LOGGER("p.app");
 
+static const seconds EVICTION_INTERVAL{60};
+// Amount of groups and topics shown in memory reports
+static const size_t MEMORY_REPORT_TOP_COUNT = 5;
+
 Application::Application(TopicOffsetReaderPtr topic_reader,
                          ConsumerOffsetReaderPtr consumer_reader)
 : topic_reader_(move(topic_reader)), consumer_reader_(move(consumer_reader)) {
@@ -19,15 +28,30 @@ Application::Application(TopicOffsetReaderPtr topic_reader,
 }
 
 void Application::run() {
+    if (snapshot_) {
+        load_snapshot();
+    }
+    const auto store = consumer_reader_->get_store();
+    // Enable notifications on the offset store. Consumer groups only trigger them once the
+    // __consumer_offsets partition they live in is loaded
+    store->enable_notifications();
+
+    if (memory_report_interval_ > seconds(0)) {
+        task_scheduler_.add_task([&] { report_memory_usage(); }, memory_report_interval_);
+    }
+
+    // Launch plugins right away, they can check which groups are ready through the store
+    LOG4CXX_INFO(logger, "Initializing " << plugins_.size() << " plugins");
+    for (auto& plugin_ptr : plugins_) {
+        plugin_ptr->launch(store);
+    }
+
     auto on_consumer_offset_eof = [&] {
-        const auto store = consumer_reader_->get_store();
-        // Enable notifications on the offset store
-        store->enable_notifications();
-
-        LOG4CXX_INFO(logger, "Initializing " << plugins_.size() << " plugins");
-        // When we finish loading the __consumer_offsets topic, launch all plugins
-        for (auto& plugin_ptr : plugins_) {
-            plugin_ptr->launch(store);
+        if (snapshot_) {
+            task_scheduler_.add_task([&] { save_snapshot(); }, snapshot_interval_);
+        }
+        if (consumer_ttl_ > seconds(0)) {
+            task_scheduler_.add_task([&] { evict_consumers(); }, EVICTION_INTERVAL);
         }
     };
 
@@ -46,6 +70,11 @@ void Application::run() {
     for (thread& th : threads) {
         th.join();
     }
+
+    // Save whatever we have so the next run starts from here
+    if (snapshot_) {
+        save_snapshot();
+    }
 }
 
 void Application::stop() {
@@ -57,8 +86,77 @@ void Application::add_plugin(PluginPtr plugin) {
     plugins_.emplace_back(move(plugin));
 }
 
+void Application::enable_snapshots(string path, seconds interval) {
+    snapshot_.reset(new OffsetStoreSnapshot(move(path)));
+    snapshot_interval_ = interval;
+}
+
+void Application::enable_consumer_eviction(seconds ttl) {
+    consumer_ttl_ = ttl;
+}
+
+void Application::enable_memory_reports(seconds interval) {
+    memory_report_interval_ = interval;
+}
+
 void Application::process() {
 
 }
 
+void Application::load_snapshot() {
+    try {
+        if (!snapshot_->load(*consumer_reader_->get_store())) {
+            LOG4CXX_INFO(logger, "No snapshot found at " << snapshot_->get_path()
+                         << ", performing full load");
+        }
+    }
+    catch (const Exception& ex) {
+        LOG4CXX_ERROR(logger, "Failed to load snapshot, performing full load: " << ex.what());
+    }
+}
+
+void Application::save_snapshot() {
+    try {
+        snapshot_->save(*consumer_reader_->get_store());
+    }
+    catch (const Exception& ex) {
+        LOG4CXX_ERROR(logger, "Failed to save snapshot: " << ex.what());
+    }
+}
+
+void Application::evict_consumers() {
+    const vector<string> groups = consumer_reader_->get_store()->remove_inactive_consumers(
+        consumer_ttl_);
+    if (!groups.empty()) {
+        LOG4CXX_INFO(logger, "Removed " << groups.size() << " groups that didn't commit in the "
+                     "last " << consumer_ttl_.count() << " seconds");
+    }
+}
+
+void Application::report_memory_usage() {
+    const auto store = consumer_reader_->get_store();
+    vector<MemoryUsage> usages = store->get_memory_usage();
+    for (const MemoryUsage& usage : topic_reader_->get_memory_usage()) {
+        usages.emplace_back(usage);
+    }
+    for (const MemoryUsage& usage : consumer_reader_->get_memory_usage()) {
+        usages.emplace_back(usage);
+    }
+    size_t total_bytes = 0;
+    for (const MemoryUsage& usage : usages) {
+        LOG4CXX_INFO(logger, "Memory used by " << usage.name << ": " << usage.bytes
+                     << " bytes, " << usage.entries << " entries");
+        total_bytes += usage.bytes;
+    }
+    LOG4CXX_INFO(logger, "Estimated total memory used: " << total_bytes << " bytes");
+    for (const MemoryUsage& usage : store->get_largest_consumers(MEMORY_REPORT_TOP_COUNT)) {
+        LOG4CXX_INFO(logger, "Group " << usage.name << " uses " << usage.bytes << " bytes, "
+                     << usage.entries << " offsets");
+    }
+    for (const MemoryUsage& usage : store->get_largest_topics(MEMORY_REPORT_TOP_COUNT)) {
+        LOG4CXX_INFO(logger, "Topic " << usage.name << " uses " << usage.bytes << " bytes, "
+                     << usage.entries << " partitions");
+    }
+}
+
 } // pirulo
@@ -1,4 +1,7 @@
 #include <cstdint>
+#include <thread>
+#include <algorithm>
+#include <boost/functional/hash.hpp>
 #include "consumer_offset_reader.h"
 #include "exceptions.h"
 #include "detail/memory.h"
@@ -7,11 +10,27 @@
 
 using std::move;
 using std::string;
+using std::vector;
+using std::thread;
+using std::mutex;
+using std::lock_guard;
+using std::max;
+using std::set;
+using std::pair;
+using std::find;
+
+using std::this_thread::sleep_for;
 
 using std::chrono::milliseconds;
+using std::chrono::system_clock;
+using std::chrono::duration_cast;
+
+using boost::string_ref;
+using boost::optional;
 
+using cppkafka::Buffer;
 using cppkafka::Configuration;
-using cppkafka::ConsumerDispatcher;
+using cppkafka::Consumer;
 using cppkafka::Message;
 using cppkafka::TopicPartition;
 using cppkafka::TopicPartitionList;
@@ -20,6 +39,72 @@ namespace pirulo {
 
 PIRULO_CREATE_LOGGER("p.offsets");
 
+static const uint16_t OFFSET_COMMIT_KEY_VERSION = 1;
+static const uint16_t GROUP_METADATA_KEY_VERSION = 2;
+static const uint16_t MAXIMUM_OFFSET_COMMIT_VALUE_VERSION = 4;
+static const uint16_t MAXIMUM_GROUP_METADATA_VALUE_VERSION = 4;
+// Group metadata value versions starting at this one use compact strings and arrays
+static const uint16_t FLEXIBLE_GROUP_METADATA_VALUE_VERSION = 4;
+static const size_t MAXIMUM_COALESCED_COMMITS = 500000;
+// Each coalesced commit references a group and a topic, so this only triggers once the names
+// seen add up to more than a full chunk could use, e.g. because of groups that went away
+static const size_t MAXIMUM_INTERNED_STRINGS = MAXIMUM_COALESCED_COMMITS * 2;
+static const string OFFSETS_TOPIC = "__consumer_offsets";
+static const milliseconds METADATA_RETRY_BACKOFF{1000};
+
+// Large fetches and deep queues while replaying
+static const ConsumerOffsetReader::ConsumptionProfile DEFAULT_COLD_START_PROFILE = {
+    {
+        { "fetch.wait.max.ms", "500" },
+        { "fetch.min.bytes", "1048576" },
+        { "fetch.message.max.bytes", "8388608" },
+        { "queued.min.messages", "1000000" }
+    },
+    10000,
+    milliseconds(100)
+};
+
+// Small fetch waits afterwards, so commits are seen as soon as possible
+static const ConsumerOffsetReader::ConsumptionProfile DEFAULT_STEADY_STATE_PROFILE = {
+    {
+        { "fetch.wait.max.ms", "10" },
+        { "fetch.min.bytes", "1" },
+        { "queued.min.messages", "1000" }
+    },
+    1000,
+    milliseconds(10)
+};
+
+static uint32_t read_unsigned_varint(InputMemoryStream& input) {
+    uint32_t output = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const uint8_t byte = input.read<uint8_t>();
+        output |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return output;
+        }
+    }
+    throw ParseException();
+}
+
+// Skips a nullable string. Compact ones store their length plus one, zero meaning null
+static void skip_string(InputMemoryStream& input, bool compact) {
+    if (compact) {
+        const uint32_t length = read_unsigned_varint(input);
+        input.skip(length > 0 ? length - 1 : 0);
+    }
+    else {
+        const int16_t length = input.read_be<int16_t>();
+        input.skip(length > 0 ? length : 0);
+    }
+}
+
+// The time the broker wrote a record in milliseconds since epoch, 0 if unknown
+static int64_t get_message_timestamp(const Message& msg) {
+    const auto timestamp = msg.get_timestamp();
+    return timestamp ? timestamp->get_timestamp().count() : 0;
+}
+
 static Configuration prepare_config(Configuration config) {
     config.set_default_topic_configuration({{ "auto.offset.reset", "smallest" }});
     config.set("group.id", utils::generate_group_id());
@@ -29,84 +114,479 @@ static Configuration prepare_config(Configuration config) {
 }
 
 ConsumerOffsetReader::ConsumerOffsetReader(StorePtr store, milliseconds consumer_offset_cool_down,
-                                           Configuration config) :
-    store_(move(store)), consumer_(prepare_config(move(config))),
-    observer_(consumer_offset_cool_down) {
+                                           Configuration config)
+: ConsumerOffsetReader(move(store), 1, consumer_offset_cool_down, move(config)) {
 
 }
 
+ConsumerOffsetReader::ConsumerOffsetReader(StorePtr store, size_t thread_count,
+                                           milliseconds consumer_offset_cool_down,
+                                           Configuration config)
+: store_(move(store)), config_(prepare_config(move(config))),
+  cold_start_profile_(DEFAULT_COLD_START_PROFILE),
+  steady_state_profile_(DEFAULT_STEADY_STATE_PROFILE), observer_(consumer_offset_cool_down) {
+    // Consumers are created once we run, so the consumption profiles can still be changed
+    for (size_t i = 0; i < max<size_t>(thread_count, 1); ++i) {
+        consumers_.emplace_back(new ConsumerContext());
+    }
+}
+
 void ConsumerOffsetReader::run(const EofCallback& callback) {
-    consumer_.set_assignment_callback([&](const TopicPartitionList& topic_partitions) {
+    LOG4CXX_INFO(logger, "Starting loading consumer offsets using " << consumers_.size()
+                 << " consumers");
+    for (const ConsumerContextPtr& context : consumers_) {
+        create_consumer(*context, cold_start_profile_);
+    }
+    if (manual_assignment_ && !assign_partitions()) {
+        return;
+    }
+    // The first consumer runs on this thread
+    vector<thread> threads;
+    for (size_t i = 1; i < consumers_.size(); ++i) {
+        threads.emplace_back([&, i] {
+            run_consumer(*consumers_[i], callback);
+        });
+    }
+    run_consumer(*consumers_.front(), callback);
+
+    for (thread& th : threads) {
+        th.join();
+    }
+}
+
+void ConsumerOffsetReader::stop() {
+    running_ = false;
+}
+
+void ConsumerOffsetReader::set_manual_assignment(bool enabled) {
+    manual_assignment_ = enabled;
+}
+
+void ConsumerOffsetReader::set_partitions(set<int> partitions) {
+    partitions_ = move(partitions);
+}
+
+void ConsumerOffsetReader::set_cold_start_horizon(milliseconds horizon) {
+    cold_start_horizon_ = horizon;
+}
+
+void ConsumerOffsetReader::set_cold_start_profile(ConsumptionProfile profile) {
+    cold_start_profile_ = move(profile);
+}
+
+void ConsumerOffsetReader::set_steady_state_profile(ConsumptionProfile profile) {
+    steady_state_profile_ = move(profile);
+}
+
+void ConsumerOffsetReader::watch_commits(const string& topic, int partition,
+                                         TopicCommitCallback callback) {
+    auto wrapped_callback = [callback](const TopicPartition& topic_partition) {
+        callback(topic_partition.get_topic(), topic_partition.get_partition());
+    };
+    observer_.observe({ topic, partition }, move(wrapped_callback));
+}
+
+void ConsumerOffsetReader::unwatch_commits(const string& topic, int partition) {
+    observer_.unobserve({ topic, partition });
+}
+
+vector<MemoryUsage> ConsumerOffsetReader::get_memory_usage() const {
+    return { { "commit watches", observer_.get_observed_count(),
+               observer_.get_memory_usage() } };
+}
+
+ConsumerOffsetReader::StorePtr ConsumerOffsetReader::get_store() const {
+    return store_;
+}
+
+void ConsumerOffsetReader::create_consumer(ConsumerContext& context,
+                                           const ConsumptionProfile& profile) {
+    // Use the same group id on every consumer so they split the partitions among them
+    Configuration config = config_;
+    for (const auto& option_pair : profile.options) {
+        config.set(option_pair.first, option_pair.second);
+    }
+    // Get rid of the old one first so it leaves the group before the new one joins
+    context.consumer.reset();
+    context.consumer.reset(new Consumer(move(config)));
+    context.profile = &profile;
+}
+
+bool ConsumerOffsetReader::assign_partitions() {
+    Consumer& consumer = *consumers_.front()->consumer;
+    size_t partition_count = 0;
+    while (running_) {
+        try {
+            partition_count = consumer.get_metadata(consumer.get_topic(OFFSETS_TOPIC))
+                                      .get_partitions().size();
+            break;
+        }
+        catch (const cppkafka::Exception& ex) {
+            LOG4CXX_ERROR(logger, "Failed to fetch " << OFFSETS_TOPIC << " metadata: "
+                          << ex.what());
+            sleep_for(METADATA_RETRY_BACKOFF);
+        }
+    }
+    if (partition_count == 0) {
+        return false;
+    }
+
+    TopicPartitionList topic_partitions;
+    for (size_t i = 0; i < partition_count; ++i) {
+        if (partitions_.empty() || partitions_.count(i)) {
+            topic_partitions.emplace_back(OFFSETS_TOPIC, static_cast<int>(i));
+        }
+    }
+    if (topic_partitions.empty()) {
+        LOG4CXX_ERROR(logger, "None of the requested partitions exist");
+        return false;
+    }
+    LOG4CXX_INFO(logger, "Assigning " << topic_partitions.size() << " partitions to "
+                 << consumers_.size() << " consumers");
+    set_starting_offsets(consumer, topic_partitions);
+
+    lock_guard<mutex> _(pending_partitions_mutex_);
+    for (size_t i = 0; i < topic_partitions.size(); ++i) {
+        ConsumerContext& context = *consumers_[i % consumers_.size()];
+        pending_partitions_.emplace(topic_partitions[i].get_partition());
+        context.assignment.emplace_back(move(topic_partitions[i]));
+    }
+    // Every consumer got its share already
+    for (const ConsumerContextPtr& context : consumers_) {
+        context->assigned = true;
+    }
+    assigned_consumers_ = consumers_.size();
+    return true;
+}
+
+void ConsumerOffsetReader::start_consumption(ConsumerContext& context) {
+    if (!manual_assignment_) {
+        subscribe(context);
+    }
+    else if (!context.assignment.empty()) {
+        context.consumer->assign(context.assignment);
+    }
+}
+
+void ConsumerOffsetReader::subscribe(ConsumerContext& context) {
+    context.consumer->set_assignment_callback([&](TopicPartitionList& topic_partitions) {
+        set_starting_offsets(*context.consumer, topic_partitions);
+
+        lock_guard<mutex> _(pending_partitions_mutex_);
         for (const TopicPartition& topic_partition : topic_partitions) {
             pending_partitions_.emplace(topic_partition.get_partition());
         }
+        if (!context.assigned) {
+            context.assigned = true;
+            assigned_consumers_++;
+        }
     });
-    LOG4CXX_INFO(logger, "Starting loading consumer offsets");
-    
-    consumer_.subscribe({ "__consumer_offsets" });
-    dispatcher_.run(
-        [&](Message msg) {
-            try {
-                if (msg.get_payload()) {
-                    handle_message(msg);
+    // Whatever was read from the revoked partitions has to be on the store before their new
+    // owner starts storing commits for them, otherwise these could overwrite newer ones
+    context.consumer->set_revocation_callback([&](const TopicPartitionList&) {
+        flush_updates(context);
+    });
+    context.consumer->subscribe({ OFFSETS_TOPIC });
+}
+
+void ConsumerOffsetReader::set_starting_offsets(Consumer& consumer,
+                                                TopicPartitionList& topic_partitions) const {
+    const milliseconds horizon_timestamp = duration_cast<milliseconds>(
+        system_clock::now().time_since_epoch()
+    ) - cold_start_horizon_;
+    Consumer::TopicPartitionsTimestampsMap timestamps;
+    for (TopicPartition& topic_partition : topic_partitions) {
+        // If the store already reflects part of this partition, e.g. because it was loaded
+        // from a snapshot, resume from there
+        const int partition = topic_partition.get_partition();
+        const optional<int64_t> position = store_->get_consumer_offsets_position(partition);
+        if (position) {
+            topic_partition.set_offset(*position);
+            continue;
+        }
+        topic_partition.set_offset(TopicPartition::OFFSET_BEGINNING);
+        if (cold_start_horizon_.count() > 0) {
+            timestamps.emplace(topic_partition, horizon_timestamp);
+        }
+    }
+    if (timestamps.empty()) {
+        return;
+    }
+
+    TopicPartitionList horizon_offsets;
+    try {
+        horizon_offsets = consumer.get_offsets_for_times(timestamps);
+    }
+    catch (const cppkafka::Exception& ex) {
+        LOG4CXX_WARN(logger, "Failed to find offsets for cold start horizon, falling back to "
+                     << "full replay: " << ex.what());
+        return;
+    }
+    for (const TopicPartition& horizon_offset : horizon_offsets) {
+        auto iter = find(topic_partitions.begin(), topic_partitions.end(), horizon_offset);
+        // A negative offset means every record is older than the horizon, so there's
+        // nothing there worth reading
+        if (iter != topic_partitions.end()) {
+            iter->set_offset(horizon_offset.get_offset() >= 0 ? horizon_offset.get_offset() :
+                             static_cast<int64_t>(TopicPartition::OFFSET_END));
+        }
+    }
+}
+
+void ConsumerOffsetReader::run_consumer(ConsumerContext& context, const EofCallback& callback) {
+    start_consumption(context);
+    vector<int> eof_partitions;
+    while (running_) {
+        // Once everything's loaded, move on to the steady state profile
+        if (finished_loading_ && context.profile != &steady_state_profile_) {
+            switch_to_steady_state(context);
+        }
+        const ConsumptionProfile& profile = *context.profile;
+        const vector<Message> messages = context.consumer->poll_batch(profile.batch_size,
+                                                                      profile.batch_timeout);
+
+        for (const Message& msg : messages) {
+            if (msg.get_error()) {
+                if (msg.is_eof()) {
+                    context.positions[msg.get_partition()] = msg.get_offset();
+                    eof_partitions.emplace_back(msg.get_partition());
                 }
+                else {
+                    LOG4CXX_WARN(logger, "Error consuming consumer offsets: "
+                                 << msg.get_error().to_string());
+                }
+                continue;
+            }
+            context.positions[msg.get_partition()] = msg.get_offset() + 1;
+            try {
+                handle_message(context, msg);
             }
             catch (const ParseException&) {
                 LOG4CXX_WARN(logger, "Failed to parse consumer offset record");
             }
-        },
-        [&](ConsumerDispatcher::EndOfFile, const TopicPartition& topic_partition) {
-            // If we reached EOF on all partitions, execute the EOF callback
-            if (pending_partitions_.erase(topic_partition.get_partition()) &&
-                pending_partitions_.empty()) {
-                LOG4CXX_INFO(logger, "Finished loading consumer offsets");
-                callback();
-
-                // Enable notifications for new commits
-                notifications_enabled_ = true;
+        }
+        // While loading, the same keys show up over and over again as the topic is not fully
+        // compacted. Only keep the latest commit for each of them and apply them in large
+        // chunks, so the store only sees each distinct key once
+        if (finished_loading_) {
+            flush_updates(context);
+        }
+        else {
+            coalesce_updates(context);
+            if (!eof_partitions.empty() ||
+                context.coalesced_commits.size() >= MAXIMUM_COALESCED_COMMITS) {
+                flush_updates(context);
             }
         }
-    );
-}
 
-void ConsumerOffsetReader::stop() {
-    dispatcher_.stop();
+        // Only handle EOFs once everything before them is on the store
+        if (!eof_partitions.empty()) {
+            handle_eofs(eof_partitions, callback);
+            eof_partitions.clear();
+        }
+    }
+    flush_updates(context);
 }
 
-void ConsumerOffsetReader::watch_commits(const string& topic, int partition,
-                                         TopicCommitCallback callback) {
-    auto wrapped_callback = [callback](const TopicPartition& topic_partition) {
-        callback(topic_partition.get_topic(), topic_partition.get_partition());
-    };
-    observer_.observe({ topic, partition }, move(wrapped_callback));
+void ConsumerOffsetReader::switch_to_steady_state(ConsumerContext& context) {
+    // Everything read so far has to be on the store before anything else can read these
+    // partitions, otherwise stale commits could be applied on top of newer ones
+    flush_updates(context);
+    // librdkafka options can only be set on new consumers. Subscribed ones leave and join the
+    // group again, which triggers a rebalance
+    LOG4CXX_DEBUG(logger, "Switching consumer to steady state profile");
+    create_consumer(context, steady_state_profile_);
+    // The positions were just stored, so this picks up from wherever this consumer was at.
+    // Subscribed consumers do the same once they're assigned their partitions again
+    if (manual_assignment_) {
+        set_starting_offsets(*context.consumer, context.assignment);
+    }
+    start_consumption(context);
 }
 
-ConsumerOffsetReader::StorePtr ConsumerOffsetReader::get_store() const {
-    return store_;
+void ConsumerOffsetReader::handle_eofs(const vector<int>& partitions,
+                                       const EofCallback& callback) {
+    // Everything on these partitions is loaded so their groups can be used already
+    store_->set_consumer_offsets_partitions_ready(partitions);
+    {
+        lock_guard<mutex> _(pending_partitions_mutex_);
+        size_t erased_count = 0;
+        for (int partition : partitions) {
+            erased_count += pending_partitions_.erase(partition);
+        }
+        // Partitions can still be moved around until every consumer got its share
+        if (erased_count == 0 || !pending_partitions_.empty() ||
+            assigned_consumers_ != consumers_.size() || finished_loading_) {
+            return;
+        }
+        finished_loading_ = true;
+    }
+    // We reached EOF on all partitions, execute the EOF callback
+    LOG4CXX_INFO(logger, "Finished loading consumer offsets");
+    store_->set_consumer_offsets_loaded();
+    callback();
+
+    // Enable notifications for new commits
+    notifications_enabled_ = true;
 }
 
-void ConsumerOffsetReader::handle_message(const Message& msg) {
+void ConsumerOffsetReader::handle_message(ConsumerContext& context, const Message& msg) {
+    StringInterner& interned_strings = context.interned_strings;
     InputMemoryStream key_input(msg.get_key());
-    uint16_t version = key_input.read_be<uint16_t>();
-    if (version > 1) {
+    const uint16_t key_version = key_input.read_be<uint16_t>();
+    // Key versions 0 and 1 are offset commits and version 2 is group metadata
+    if (key_version > GROUP_METADATA_KEY_VERSION) {
+        return;
+    }
+    // Parse views into the message and intern them so already seen ids don't allocate
+    const string& group_id = interned_strings.intern(key_input.read<string_ref>());
+    if (key_version == GROUP_METADATA_KEY_VERSION) {
+        handle_group_metadata(context, group_id, msg);
         return;
     }
-    string group_id = key_input.read<string>();
-    string topic = key_input.read<string>();
+    const string& topic = interned_strings.intern(key_input.read<string_ref>());
     int partition = key_input.read_be<uint32_t>();
 
+    // A tombstone means this offset expired or the group was deleted
+    if (!msg.get_payload()) {
+        context.updates.push_back({ group_id, topic, partition, 0, true, msg.get_partition(),
+                                    get_message_timestamp(msg) });
+        return;
+    }
+
     InputMemoryStream value_input(msg.get_payload());
-    // Value version
-    version = value_input.read_be<uint16_t>();
-    if (version > 1) {
-        throw ParseException();
+    const uint16_t value_version = value_input.read_be<uint16_t>();
+    if (value_version > MAXIMUM_OFFSET_COMMIT_VALUE_VERSION) {
+        LOG4CXX_DEBUG(logger, "Skipping offset commit with unknown value version "
+                      << value_version);
+        return;
+    }
+    // The offset is the first field on every value version (0 to 4), the rest (metadata,
+    // timestamps, leader epoch and tagged fields) is not used
+    int64_t offset = value_input.read_be<uint64_t>();
+    context.updates.push_back({ group_id, topic, partition, offset, false,
+                                msg.get_partition(), get_message_timestamp(msg) });
+}
+
+void ConsumerOffsetReader::handle_group_metadata(ConsumerContext& context,
+                                                 const string& group_id, const Message& msg) {
+    using ConsumerGroupState = OffsetStore::ConsumerGroupState;
+    // A tombstone means the group was deleted
+    if (!msg.get_payload()) {
+        context.group_states[&group_id] = ConsumerGroupState::DEAD;
+        return;
+    }
+
+    const optional<ConsumerGroupState> state = parse_group_metadata(msg.get_payload());
+    if (state) {
+        context.group_states[&group_id] = *state;
+    }
+}
+
+optional<OffsetStore::ConsumerGroupState>
+ConsumerOffsetReader::parse_group_metadata(const Buffer& value) {
+    using ConsumerGroupState = OffsetStore::ConsumerGroupState;
+    InputMemoryStream value_input(value);
+    const uint16_t value_version = value_input.read_be<uint16_t>();
+    if (value_version > MAXIMUM_GROUP_METADATA_VALUE_VERSION) {
+        LOG4CXX_DEBUG(logger, "Skipping group metadata with unknown value version "
+                      << value_version);
+        return boost::none;
+    }
+    // Only the member count is needed so skip the protocol type, generation, protocol,
+    // leader and, starting on version 2, the state timestamp
+    const bool compact = value_version >= FLEXIBLE_GROUP_METADATA_VALUE_VERSION;
+    skip_string(value_input, compact);
+    value_input.skip(sizeof(int32_t));
+    skip_string(value_input, compact);
+    skip_string(value_input, compact);
+    if (value_version >= 2) {
+        value_input.skip(sizeof(int64_t));
+    }
+    // Compact arrays store their size plus one, zero meaning null
+    const bool has_members = compact ? read_unsigned_varint(value_input) > 1 :
+                                       value_input.read_be<int32_t>() > 0;
+    return has_members ? ConsumerGroupState::ACTIVE : ConsumerGroupState::EMPTY;
+}
+
+void ConsumerOffsetReader::coalesce_updates(ConsumerContext& context) {
+    for (const OffsetStore::ConsumerOffsetUpdate& update : context.updates) {
+        const CommitKey key{ &update.group_id, &update.topic, update.partition };
+        context.coalesced_commits[key] = { update.offset, update.removed,
+                                           update.offsets_partition, update.timestamp };
+    }
+    context.updates.clear();
+}
+
+void ConsumerOffsetReader::flush_updates(ConsumerContext& context) {
+    if (!context.coalesced_commits.empty()) {
+        // These are older than anything in the current batch so they go first
+        vector<OffsetStore::ConsumerOffsetUpdate> updates;
+        updates.reserve(context.coalesced_commits.size() + context.updates.size());
+        for (const auto& commit_pair : context.coalesced_commits) {
+            const CommitKey& key = commit_pair.first;
+            const CoalescedCommit& commit = commit_pair.second;
+            updates.push_back({ *key.group_id, *key.topic, key.partition, commit.offset,
+                                commit.removed, commit.offsets_partition, commit.timestamp });
+        }
+        for (const OffsetStore::ConsumerOffsetUpdate& update : context.updates) {
+            updates.push_back(update);
+        }
+        // Updates hold references so they can't be assigned, swap the vectors instead
+        context.updates.swap(updates);
+        context.coalesced_commits.clear();
+    }
+    apply_updates(context);
+    // Interned strings are only referenced by updates that haven't been applied yet, so
+    // it's safe to drop them all once those are on the store
+    if (context.interned_strings.size() > MAXIMUM_INTERNED_STRINGS) {
+        context.interned_strings.clear();
+    }
+}
+
+void ConsumerOffsetReader::apply_updates(ConsumerContext& context) {
+    if (!context.updates.empty()) {
+        store_->store_consumer_offsets(context.updates);
+    }
+    // Group states go after the offsets so a deleted group no longer has any when its
+    // state is stored
+    for (const auto& state_pair : context.group_states) {
+        store_->store_consumer_group_state(*state_pair.first, state_pair.second);
+    }
+    context.group_states.clear();
+    // Positions are only moved forward once the records before them are on the store
+    for (const auto& position_pair : context.positions) {
+        store_->set_consumer_offsets_position(position_pair.first, position_pair.second);
+    }
+    context.positions.clear();
+    if (context.updates.empty()) {
+        return;
     }
-    uint64_t offset = value_input.read_be<uint64_t>();
-    store_->store_consumer_offset(group_id, topic, partition, offset);
 
     if (notifications_enabled_) {
-        observer_.notify({ topic, partition });
+        // Interned strings are unique so they can be compared by address
+        set<pair<const string*, int>> committed_partitions;
+        for (const OffsetStore::ConsumerOffsetUpdate& update : context.updates) {
+            if (!update.removed &&
+                committed_partitions.emplace(&update.topic, update.partition).second) {
+                observer_.notify({ update.topic, update.partition });
+            }
+        }
     }
+    context.updates.clear();
+}
+
+bool ConsumerOffsetReader::CommitKey::operator==(const CommitKey& rhs) const {
+    // Interned strings are unique so they can be compared by address
+    return group_id == rhs.group_id && topic == rhs.topic && partition == rhs.partition;
+}
+
+size_t ConsumerOffsetReader::CommitKeyHasher::operator()(const CommitKey& key) const {
+    size_t output = 0;
+    boost::hash_combine(output, key.group_id);
+    boost::hash_combine(output, key.topic);
+    boost::hash_combine(output, key.partition);
+    return output;
 }
 
 } // pirulo
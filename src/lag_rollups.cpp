@@ -0,0 +1,405 @@
+#include <algorithm>
+#include "lag_rollups.h"
+#include "utils/memory_usage.h"
+
+using std::string;
+using std::mutex;
+using std::lock_guard;
+using std::vector;
+using std::max;
+using std::copy;
+
+using boost::optional;
+
+namespace pirulo {
+
+constexpr int64_t LagRollups::NO_WATERMARK;
+constexpr int64_t LagRollups::NO_LAG;
+
+void LagRollups::store_consumer_offset(const string& group_id, const string& topic,
+                                       int partition, int64_t offset) {
+    if (partition < 0) {
+        return;
+    }
+    lock_guard<mutex> _(mutex_);
+    auto topic_iter = topics_.find(topic);
+    if (topic_iter == topics_.end()) {
+        topic_iter = topics_.emplace(topic, TopicState()).first;
+    }
+    TopicState& state = topic_iter->second;
+    PartitionState& partition_state = get_partition(state, partition);
+    auto group_iter = groups_.find(group_id);
+    if (group_iter == groups_.end()) {
+        group_iter = groups_.emplace(group_id, GroupAggregate()).first;
+        group_iter->second.group_id = &group_iter->first;
+        group_iter->second.is_active = !inactive_groups_.count(group_id);
+    }
+    GroupAggregate& group = group_iter->second;
+    auto iter = partition_state.consumer_offsets.find(&group);
+    if (iter == partition_state.consumer_offsets.end()) {
+        GroupTopicAggregate& group_topic = group.topics[&state];
+        group.offset_count++;
+        group_topic.offset_count++;
+        state.offset_count++;
+        offset_count_++;
+        iter = partition_state.consumer_offsets.emplace(&group, TrackedOffset()).first;
+        TrackedOffset& tracked_offset = iter->second;
+        tracked_offset.offset = offset;
+        tracked_offset.partition = partition;
+        tracked_offset.topic = &topic_iter->first;
+        tracked_offset.group = &group;
+        tracked_offset.group_topic = &group_topic;
+        update_lag(state, tracked_offset, boost::none,
+                   compute_lag(partition_state.watermark, offset));
+    }
+    else {
+        const optional<int64_t> old_lag = compute_lag(partition_state.watermark,
+                                                      iter->second.offset);
+        iter->second.offset = offset;
+        update_lag(state, iter->second, old_lag,
+                   compute_lag(partition_state.watermark, offset));
+    }
+}
+
+void LagRollups::remove_consumer_offset(const string& group_id, const string& topic,
+                                        int partition) {
+    lock_guard<mutex> _(mutex_);
+    auto topic_iter = topics_.find(topic);
+    if (topic_iter == topics_.end() || partition < 0 ||
+        static_cast<size_t>(partition) >= topic_iter->second.partitions.size()) {
+        return;
+    }
+    auto group_iter = groups_.find(group_id);
+    if (group_iter == groups_.end()) {
+        return;
+    }
+    GroupAggregate& group = group_iter->second;
+    TopicState& state = topic_iter->second;
+    PartitionState& partition_state = state.partitions[partition];
+    auto iter = partition_state.consumer_offsets.find(&group);
+    if (iter == partition_state.consumer_offsets.end()) {
+        return;
+    }
+    TrackedOffset& tracked_offset = iter->second;
+    update_lag(state, tracked_offset,
+               compute_lag(partition_state.watermark, tracked_offset.offset), boost::none);
+    partition_state.consumer_offsets.erase(iter);
+    // Drop aggregates once they have no offsets so groups that go away don't linger
+    if (--group.topics[&state].offset_count == 0) {
+        group.topics.erase(&state);
+    }
+    if (--group.offset_count == 0) {
+        groups_.erase(group_iter);
+    }
+    state.offset_count--;
+    offset_count_--;
+    // Topics that were removed only stay while they have offsets
+    if (state.offset_count == 0 && state.is_removed) {
+        topics_.erase(topic_iter);
+    }
+}
+
+void LagRollups::store_topic_offset(const string& topic, int partition, int64_t offset) {
+    if (partition < 0) {
+        return;
+    }
+    lock_guard<mutex> _(mutex_);
+    TopicState& state = topics_[topic];
+    state.is_removed = false;
+    PartitionState& partition_state = get_partition(state, partition);
+    const int64_t watermark = partition_state.watermark;
+    if (watermark == offset) {
+        return;
+    }
+    for (auto& consumer_pair : partition_state.consumer_offsets) {
+        TrackedOffset& tracked_offset = consumer_pair.second;
+        const optional<int64_t> old_lag = compute_lag(watermark, tracked_offset.offset);
+        const optional<int64_t> new_lag = compute_lag(offset, tracked_offset.offset);
+        // Groups that were and still are caught up don't change anything
+        if (old_lag != new_lag) {
+            update_lag(state, tracked_offset, old_lag, new_lag);
+        }
+    }
+    partition_state.watermark = offset;
+}
+
+void LagRollups::remove_topic(const string& topic) {
+    lock_guard<mutex> _(mutex_);
+    auto topic_iter = topics_.find(topic);
+    if (topic_iter == topics_.end()) {
+        return;
+    }
+    TopicState& state = topic_iter->second;
+    for (PartitionState& partition_state : state.partitions) {
+        for (auto& consumer_pair : partition_state.consumer_offsets) {
+            update_lag(state, consumer_pair.second,
+                       compute_lag(partition_state.watermark, consumer_pair.second.offset),
+                       boost::none);
+        }
+        partition_state.watermark = NO_WATERMARK;
+    }
+    if (state.offset_count == 0) {
+        topics_.erase(topic_iter);
+    }
+    else {
+        state.is_removed = true;
+    }
+}
+
+void LagRollups::set_group_active(const string& group_id, bool active) {
+    lock_guard<mutex> _(mutex_);
+    if (active) {
+        inactive_groups_.erase(group_id);
+    }
+    else {
+        inactive_groups_.emplace(group_id);
+    }
+    auto group_iter = groups_.find(group_id);
+    if (group_iter == groups_.end() || group_iter->second.is_active == active) {
+        return;
+    }
+    GroupAggregate& group = group_iter->second;
+    group.is_active = active;
+    // Move the group's offsets in or out of the heap
+    for (const auto& topic_pair : group.topics) {
+        // Only the keys are const, topics themselves never are
+        TopicState& state = const_cast<TopicState&>(*topic_pair.first);
+        for (PartitionState& partition_state : state.partitions) {
+            auto iter = partition_state.consumer_offsets.find(&group);
+            if (iter == partition_state.consumer_offsets.end()) {
+                continue;
+            }
+            TrackedOffset& tracked_offset = iter->second;
+            if (!active) {
+                partition_lags_.remove(&tracked_offset);
+            }
+            else if (tracked_offset.lag != NO_LAG) {
+                partition_lags_.update(&tracked_offset, tracked_offset.lag);
+            }
+        }
+    }
+    if (!active) {
+        group_lags_.remove(&group);
+    }
+    else if (group.lag_count > 0) {
+        group_lags_.update(&group, group.total_lag);
+    }
+}
+
+void LagRollups::clear() {
+    lock_guard<mutex> _(mutex_);
+    // Heaps point into the aggregates so they go first
+    partition_lags_ = PartitionLagHeap();
+    group_lags_ = GroupLagHeap();
+    groups_.clear();
+    topics_.clear();
+    inactive_groups_.clear();
+    offset_count_ = 0;
+}
+
+optional<LagRollups::Rollup> LagRollups::get_consumer_lag(const string& group_id) const {
+    lock_guard<mutex> _(mutex_);
+    auto iter = groups_.find(group_id);
+    if (iter == groups_.end()) {
+        return boost::none;
+    }
+    return iter->second.get_rollup();
+}
+
+optional<LagRollups::Rollup> LagRollups::get_consumer_lag(const string& group_id,
+                                                          const string& topic) const {
+    lock_guard<mutex> _(mutex_);
+    const GroupTopicAggregate* group_topic = find_group_topic(group_id, topic);
+    if (!group_topic) {
+        return boost::none;
+    }
+    return group_topic->get_rollup();
+}
+
+optional<int64_t> LagRollups::get_consumer_max_lag(const string& group_id,
+                                                   const string& topic) const {
+    lock_guard<mutex> _(mutex_);
+    const GroupTopicAggregate* group_topic = find_group_topic(group_id, topic);
+    if (!group_topic || group_topic->lag_count == 0) {
+        return boost::none;
+    }
+    return group_topic->get_max_lag();
+}
+
+optional<LagRollups::Rollup> LagRollups::get_topic_lag(const string& topic) const {
+    lock_guard<mutex> _(mutex_);
+    auto iter = topics_.find(topic);
+    if (iter == topics_.end()) {
+        return boost::none;
+    }
+    return iter->second.get_rollup();
+}
+
+vector<LagRollups::PartitionLag> LagRollups::get_largest_partition_lags(size_t count) const {
+    lock_guard<mutex> _(mutex_);
+    vector<PartitionLag> output;
+    for (const TrackedOffset* tracked_offset : partition_lags_.get_largest(count)) {
+        output.push_back({ *tracked_offset->group->group_id, *tracked_offset->topic,
+                           tracked_offset->partition, tracked_offset->lag });
+    }
+    return output;
+}
+
+vector<LagRollups::GroupLag> LagRollups::get_largest_consumer_lags(size_t count) const {
+    lock_guard<mutex> _(mutex_);
+    vector<GroupLag> output;
+    for (const GroupAggregate* group : group_lags_.get_largest(count)) {
+        output.push_back({ *group->group_id, group->total_lag, group->lag_count });
+    }
+    return output;
+}
+
+size_t LagRollups::get_offset_count() const {
+    lock_guard<mutex> _(mutex_);
+    return offset_count_;
+}
+
+size_t LagRollups::get_memory_usage() const {
+    using memory::get_heap_size;
+
+    lock_guard<mutex> _(mutex_);
+    size_t output = get_heap_size(groups_) + get_heap_size(topics_) +
+                    get_heap_size(inactive_groups_) + partition_lags_.get_memory_usage() +
+                    group_lags_.get_memory_usage();
+    for (const string& group_id : inactive_groups_) {
+        output += get_heap_size(group_id);
+    }
+    for (const auto& group_pair : groups_) {
+        output += get_heap_size(group_pair.first) + get_heap_size(group_pair.second.topics);
+        for (const auto& topic_pair : group_pair.second.topics) {
+            output += get_heap_size(topic_pair.second.partition_lags);
+        }
+    }
+    for (const auto& topic_pair : topics_) {
+        output += get_heap_size(topic_pair.first) +
+                  get_heap_size(topic_pair.second.partitions);
+        for (const PartitionState& partition_state : topic_pair.second.partitions) {
+            output += get_heap_size(partition_state.consumer_offsets);
+        }
+    }
+    return output;
+}
+
+optional<int64_t> LagRollups::compute_lag(int64_t watermark, int64_t offset) {
+    if (watermark == NO_WATERMARK) {
+        return boost::none;
+    }
+    return watermark > offset ? watermark - offset : 0;
+}
+
+const LagRollups::GroupTopicAggregate*
+LagRollups::find_group_topic(const string& group_id, const string& topic) const {
+    auto group_iter = groups_.find(group_id);
+    auto topic_iter = topics_.find(topic);
+    if (group_iter == groups_.end() || topic_iter == topics_.end()) {
+        return nullptr;
+    }
+    auto iter = group_iter->second.topics.find(&topic_iter->second);
+    return iter != group_iter->second.topics.end() ? &iter->second : nullptr;
+}
+
+LagRollups::PartitionState& LagRollups::get_partition(TopicState& state, int partition) {
+    if (static_cast<size_t>(partition) >= state.partitions.size()) {
+        state.partitions.resize(partition + 1);
+    }
+    return state.partitions[partition];
+}
+
+void LagRollups::update_lag(TopicState& state, TrackedOffset& tracked_offset,
+                            const optional<int64_t>& old_lag,
+                            const optional<int64_t>& new_lag) {
+    GroupAggregate* group = tracked_offset.group;
+    if (old_lag) {
+        state.remove(*old_lag);
+        group->remove(*old_lag);
+        tracked_offset.group_topic->remove(*old_lag);
+    }
+    if (new_lag) {
+        state.add(*new_lag);
+        group->add(*new_lag);
+        tracked_offset.group_topic->add(*new_lag);
+    }
+    tracked_offset.lag = new_lag.value_or(NO_LAG);
+    tracked_offset.group_topic->set_lag(tracked_offset.partition, tracked_offset.lag);
+    if (!group->is_active) {
+        return;
+    }
+    if (new_lag) {
+        partition_lags_.update(&tracked_offset, tracked_offset.lag);
+    }
+    else {
+        partition_lags_.remove(&tracked_offset);
+    }
+    if (group->lag_count > 0) {
+        group_lags_.update(group, group->total_lag);
+    }
+    else {
+        group_lags_.remove(group);
+    }
+}
+
+void LagRollups::Aggregate::add(int64_t lag) {
+    total_lag += lag;
+    lag_count++;
+}
+
+void LagRollups::Aggregate::remove(int64_t lag) {
+    total_lag -= lag;
+    lag_count--;
+}
+
+optional<LagRollups::Rollup> LagRollups::Aggregate::get_rollup() const {
+    if (lag_count == 0) {
+        return boost::none;
+    }
+    return Rollup{ total_lag, lag_count };
+}
+
+void LagRollups::GroupTopicAggregate::set_lag(int partition, int64_t lag) {
+    size_t leaf_count = partition_lags.size() / 2;
+    if (static_cast<size_t>(partition) >= leaf_count) {
+        // Grow to the next power of two and rebuild the tree out of the current leaves
+        size_t new_leaf_count = max<size_t>(leaf_count, 1);
+        while (new_leaf_count <= static_cast<size_t>(partition)) {
+            new_leaf_count *= 2;
+        }
+        vector<int64_t> new_lags(new_leaf_count * 2, NO_LAG);
+        copy(partition_lags.begin() + leaf_count, partition_lags.end(),
+             new_lags.begin() + new_leaf_count);
+        for (size_t i = new_leaf_count - 1; i > 0; --i) {
+            new_lags[i] = max(new_lags[i * 2], new_lags[i * 2 + 1]);
+        }
+        partition_lags.swap(new_lags);
+        leaf_count = new_leaf_count;
+    }
+    size_t index = leaf_count + partition;
+    partition_lags[index] = lag;
+    for (index /= 2; index > 0; index /= 2) {
+        partition_lags[index] = max(partition_lags[index * 2], partition_lags[index * 2 + 1]);
+    }
+}
+
+int64_t LagRollups::GroupTopicAggregate::get_max_lag() const {
+    return partition_lags.empty() ? NO_LAG : partition_lags[1];
+}
+
+bool LagRollups::Rollup::operator==(const Rollup& rhs) const {
+    return total_lag == rhs.total_lag && offset_count == rhs.offset_count;
+}
+
+bool LagRollups::PartitionLag::operator==(const PartitionLag& rhs) const {
+    return group_id == rhs.group_id && topic == rhs.topic && partition == rhs.partition &&
+           lag == rhs.lag;
+}
+
+bool LagRollups::GroupLag::operator==(const GroupLag& rhs) const {
+    return group_id == rhs.group_id && total_lag == rhs.total_lag &&
+           offset_count == rhs.offset_count;
+}
+
+} // pirulo
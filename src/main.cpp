@@ -19,6 +19,7 @@ using std::unique_ptr;
 using std::function;
 
 using std::chrono::seconds;
+using std::chrono::minutes;
 
 using cppkafka::Configuration;
 
@@ -41,6 +42,16 @@ int main(int argc, char* argv[]) {
     string brokers;
     string group_id;
     unsigned threads;
+    unsigned offsets_threads;
+    unsigned offsets_horizon;
+    string snapshot_file;
+    unsigned snapshot_interval;
+    size_t history_size;
+    size_t maximum_history_size;
+    double timestamp_fetch_rate;
+    unsigned group_ttl;
+    unsigned deleted_topic_ttl;
+    unsigned memory_report_interval;
 
     po::options_description options("Options");
     options.add_options()
@@ -49,6 +60,38 @@ int main(int argc, char* argv[]) {
                          "the kafka broker list")
         ("threads,t",    po::value<unsigned>(&threads)->default_value(2),
                          "amount of threads to use for topic metadata reloading")
+        ("offsets-threads", po::value<unsigned>(&offsets_threads)->default_value(1),
+                         "amount of threads to use for __consumer_offsets consumption")
+        ("manual-assignment", "assign __consumer_offsets partitions explicitly instead of "
+                              "joining a consumer group")
+        ("offsets-horizon", po::value<unsigned>(&offsets_horizon)->default_value(0),
+                         "skip __consumer_offsets records older than this amount of minutes "
+                         "on cold start, 0 replays everything")
+        ("ignore-inactive-groups", "don't compute lag for groups that have no members")
+        ("lag-rollups", "keep per group and per topic lag totals and the largest lags up "
+                        "to date")
+        ("history-size", po::value<size_t>(&history_size)->default_value(0),
+                         "amount of bytes of offset history to keep for each topic partition "
+                         "and each group partition, 0 disables it")
+        ("max-history-size", po::value<size_t>(&maximum_history_size)->default_value(0),
+                         "amount of bytes of offset history to keep in total. Partitions seen "
+                         "once it's reached keep no history. 0 means no limit")
+        ("timestamp-fetch-rate", po::value<double>(&timestamp_fetch_rate)->default_value(0),
+                         "maximum amount of fetches per second used to sample the timestamps "
+                         "of the messages at committed offsets, 0 disables it")
+        ("group-ttl", po::value<unsigned>(&group_ttl)->default_value(0),
+                         "remove groups that didn't commit in this amount of minutes, 0 keeps "
+                         "them until their offsets expire")
+        ("deleted-topic-ttl", po::value<unsigned>(&deleted_topic_ttl)->default_value(10),
+                         "amount of minutes a topic has to be missing from the metadata to be "
+                         "considered deleted")
+        ("memory-report-interval",
+                         po::value<unsigned>(&memory_report_interval)->default_value(600),
+                         "amount of seconds between memory usage reports, 0 disables them")
+        ("snapshot-file", po::value<string>(&snapshot_file),
+                         "the file used to persist the store across restarts")
+        ("snapshot-interval", po::value<unsigned>(&snapshot_interval)->default_value(60),
+                         "amount of seconds between snapshots")
         ;
 
     po::variables_map vm;
@@ -74,11 +117,25 @@ int main(int argc, char* argv[]) {
     };
 
     auto store = make_shared<OffsetStore>();
-    auto consumer_reader = make_shared<ConsumerOffsetReader>(store, seconds(10), config);
+    store->set_ignore_inactive_consumers(vm.count("ignore-inactive-groups") > 0);
+    store->set_history_size(history_size);
+    store->set_maximum_history_size(maximum_history_size);
+    store->set_lag_rollups_enabled(vm.count("lag-rollups") > 0);
+    auto consumer_reader = make_shared<ConsumerOffsetReader>(store, offsets_threads,
+                                                             seconds(10), config);
+    consumer_reader->set_manual_assignment(vm.count("manual-assignment") > 0);
+    consumer_reader->set_cold_start_horizon(minutes(offsets_horizon));
     auto topic_reader = make_shared<TopicOffsetReader>(store, threads, consumer_reader,
                                                        config);
+    topic_reader->enable_timestamp_sampling(timestamp_fetch_rate);
+    topic_reader->set_deleted_topic_ttl(minutes(deleted_topic_ttl));
 
     Application app(move(topic_reader), move(consumer_reader));
+    if (!snapshot_file.empty()) {
+        app.enable_snapshots(snapshot_file, seconds(snapshot_interval));
+    }
+    app.enable_consumer_eviction(minutes(group_ttl));
+    app.enable_memory_reports(seconds(memory_report_interval));
     // app.add_plugin(unique_ptr<PythonPlugin>(new PythonPlugin("../plugins",
     //                                                         "../plugins/logger.py")));
     app.add_plugin(unique_ptr<PythonPlugin>(new PythonPlugin("../plugins",
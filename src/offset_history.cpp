@@ -0,0 +1,171 @@
+#include <algorithm>
+#include "offset_history.h"
+#include "exceptions.h"
+
+using std::vector;
+using std::min;
+using std::max;
+
+using boost::optional;
+
+namespace pirulo {
+
+// The most an encoded sample can take: two 10 byte varints
+static const size_t MAXIMUM_SAMPLE_SIZE = 20;
+static const size_t MINIMUM_BLOCK_SIZE = 64;
+// Series are split into this many blocks so dropping one doesn't lose too much
+static const size_t BLOCKS_PER_SERIES = 4;
+
+static void write_varint(vector<uint8_t>& output, int64_t value) {
+    // Zigzag encode it so small negative values stay small
+    uint64_t encoded = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    while (encoded >= 0x80) {
+        output.push_back(static_cast<uint8_t>(encoded) | 0x80);
+        encoded >>= 7;
+    }
+    output.push_back(static_cast<uint8_t>(encoded));
+}
+
+static int64_t read_varint(const vector<uint8_t>& input, size_t& position) {
+    uint64_t encoded = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position == input.size()) {
+            throw ParseException();
+        }
+        const uint8_t byte = input[position++];
+        encoded |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+        }
+    }
+    throw ParseException();
+}
+
+// Where the offset falls between two samples, the first one being at or below it
+static int64_t interpolate_timestamp(const OffsetHistory::Sample& previous,
+                                     const OffsetHistory::Sample& next, int64_t offset) {
+    const double ratio = static_cast<double>(offset - previous.offset) /
+                         (next.offset - previous.offset);
+    return previous.timestamp + static_cast<int64_t>(ratio * (next.timestamp - previous.timestamp));
+}
+
+OffsetHistory::OffsetHistory(size_t maximum_size)
+: maximum_size_(maximum_size) {
+
+}
+
+void OffsetHistory::add_sample(int64_t timestamp, int64_t offset) {
+    const Sample sample{ timestamp, offset };
+    if (!blocks_.empty() && timestamp < blocks_.back().last.timestamp) {
+        return;
+    }
+    if (blocks_.empty() || blocks_.back().data.size() + MAXIMUM_SAMPLE_SIZE > get_block_size()) {
+        blocks_.push_back({ sample, sample, offset, 0, 0, {} });
+        blocks_.back().data.reserve(get_block_size());
+        size_ += sizeof(Block) + blocks_.back().data.capacity();
+        // Always keep the block being written to
+        while (size_ > maximum_size_ && blocks_.size() > 1) {
+            size_ -= sizeof(Block) + blocks_.front().data.capacity();
+            blocks_.pop_front();
+        }
+        return;
+    }
+    Block& block = blocks_.back();
+    const int64_t timestamp_delta = timestamp - block.last.timestamp;
+    const int64_t offset_delta = offset - block.last.offset;
+    write_varint(block.data, timestamp_delta - block.timestamp_delta);
+    write_varint(block.data, offset_delta - block.offset_delta);
+    block.timestamp_delta = timestamp_delta;
+    block.offset_delta = offset_delta;
+    block.last = sample;
+    block.minimum_offset = min(block.minimum_offset, offset);
+}
+
+vector<OffsetHistory::Sample> OffsetHistory::get_samples(int64_t start, int64_t end) const {
+    vector<Sample> output;
+    for (const Block& block : blocks_) {
+        if (block.last.timestamp < start || block.first.timestamp > end) {
+            continue;
+        }
+        visit_samples(block, [&](const Sample& sample) {
+            if (sample.timestamp >= start && sample.timestamp <= end) {
+                output.push_back(sample);
+            }
+        });
+    }
+    return output;
+}
+
+optional<int64_t> OffsetHistory::find_timestamp(int64_t offset) const {
+    // Offsets can go backwards, e.g. if a topic is recreated, so only the latest crossing
+    // counts. Go backwards from the newest block until one has a sample at or below the
+    // offset. Only that one is decoded, and only if its last sample isn't the one
+    Sample next{ 0, 0 };
+    bool has_next = false;
+    for (auto block_iter = blocks_.rbegin(); block_iter != blocks_.rend(); ++block_iter) {
+        const Block& block = *block_iter;
+        if (block.minimum_offset > offset) {
+            next = block.first;
+            has_next = true;
+            continue;
+        }
+        // The latest sample at or below the offset and the one right after it, if any
+        Sample previous = block.last;
+        if (block.last.offset > offset) {
+            has_next = false;
+            visit_samples(block, [&](const Sample& sample) {
+                if (sample.offset <= offset) {
+                    previous = sample;
+                    has_next = false;
+                }
+                else if (!has_next) {
+                    next = sample;
+                    has_next = true;
+                }
+            });
+        }
+        if (!has_next) {
+            return boost::none;
+        }
+        return interpolate_timestamp(previous, next, offset);
+    }
+    return boost::none;
+}
+
+bool OffsetHistory::empty() const {
+    return blocks_.empty();
+}
+
+size_t OffsetHistory::get_size() const {
+    return size_;
+}
+
+template <typename Functor>
+void OffsetHistory::visit_samples(const Block& block, const Functor& callback) {
+    Sample sample = block.first;
+    callback(sample);
+    int64_t timestamp_delta = 0;
+    int64_t offset_delta = 0;
+    size_t position = 0;
+    while (position < block.data.size()) {
+        timestamp_delta += read_varint(block.data, position);
+        offset_delta += read_varint(block.data, position);
+        sample.timestamp += timestamp_delta;
+        sample.offset += offset_delta;
+        callback(sample);
+    }
+}
+
+size_t OffsetHistory::get_maximum_size() const {
+    return max(maximum_size_, sizeof(Block) + get_block_size());
+}
+
+size_t OffsetHistory::get_block_size() const {
+    return max(maximum_size_ / BLOCKS_PER_SERIES, MINIMUM_BLOCK_SIZE);
+}
+
+bool OffsetHistory::Sample::operator==(const Sample& rhs) const {
+    return timestamp == rhs.timestamp && offset == rhs.offset;
+}
+
+} // pirulo
@@ -1,15 +1,42 @@
+#include <tuple>
+#include <algorithm>
+#include <limits>
 #include "offset_store.h"
 
 using std::string;
 using std::mutex;
 using std::lock_guard;
 using std::vector;
+using std::map;
+using std::unordered_map;
+using std::set;
 using std::move;
+using std::tie;
+using std::hash;
+using std::pair;
+using std::make_pair;
+using std::sort;
+using std::unique;
+using std::reverse;
+using std::lower_bound;
+using std::shared_ptr;
+using std::make_shared;
+using std::unique_lock;
+using std::thread;
+using std::min;
+using std::max;
+using std::numeric_limits;
+using std::find_if;
+using std::partial_sort;
 
 using std::chrono::seconds;
 using std::chrono::milliseconds;
+using std::chrono::microseconds;
+using std::chrono::system_clock;
+using std::chrono::duration_cast;
 
 using boost::optional;
+using boost::string_ref;
 
 using cppkafka::TopicPartition;
 
@@ -17,24 +44,93 @@ namespace pirulo {
 
 static const int NEW_CONSUMER_ID = 0;
 static const int NEW_TOPIC_ID = 1;
+static const int COMMIT_BATCH_ID = 0;
+
+// Milliseconds since epoch
+static int64_t get_current_timestamp() {
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Adds to the usage with the given name, creating it if needed
+static void add_usage(vector<MemoryUsage>& output, const string& name, size_t entries,
+                      size_t bytes) {
+    auto iter = find_if(output.begin(), output.end(), [&](const MemoryUsage& usage) {
+        return usage.name == name;
+    });
+    if (iter == output.end()) {
+        output.push_back({ name, entries, bytes });
+    }
+    else {
+        iter->entries += entries;
+        iter->bytes += bytes;
+    }
+}
+
+// Keeps the largest count usages, sorted by size
+static void keep_largest(vector<MemoryUsage>& usages, size_t count) {
+    count = min(count, usages.size());
+    partial_sort(usages.begin(), usages.begin() + count, usages.end(),
+                 [](const MemoryUsage& lhs, const MemoryUsage& rhs) {
+        return lhs.bytes > rhs.bytes;
+    });
+    usages.resize(count);
+}
+
+constexpr int64_t OffsetStore::NO_OFFSET;
+constexpr size_t OffsetStore::MAXIMUM_REMOVED_OFFSETS;
+constexpr size_t OffsetStore::MAXIMUM_CHANGE_BATCHES;
+constexpr size_t OffsetStore::MAXIMUM_CHANGED_IDS;
+constexpr size_t OffsetStore::MAXIMUM_TIMESTAMP_BUCKETS;
 
 // TODO: don't hardcode these constants
 OffsetStore::OffsetStore()
-: new_string_observer_(thread_pool_), consumer_commit_observer_(thread_pool_, seconds(10)),
-  topic_message_observer_(thread_pool_, seconds(10)) {
+: consumer_shards_(CONSUMER_SHARD_COUNT), topic_shards_(TOPIC_SHARD_COUNT),
+  new_string_observer_(thread_pool_),
+  consumer_commit_observer_(thread_pool_, seconds(10)),
+  topic_message_observer_(thread_pool_, seconds(10)), commit_batch_observer_(thread_pool_),
+  // Start at the current time so versions keep increasing across restarts
+  version_(duration_cast<microseconds>(system_clock::now().time_since_epoch()).count()) {
+    for (ConsumerShard& shard : consumer_shards_) {
+        shard.view = make_shared<const ConsumerShardData>();
+    }
+    for (TopicShard& shard : topic_shards_) {
+        shard.view = make_shared<const TopicShardData>();
+    }
+    publisher_thread_ = thread(&OffsetStore::run_publisher, this);
+}
 
+OffsetStore::~OffsetStore() {
+    {
+        lock_guard<mutex> _(publisher_mutex_);
+        publisher_running_ = false;
+    }
+    publisher_condition_.notify_one();
+    publisher_thread_.join();
 }
 
 void OffsetStore::store_consumer_offset(const string& group_id, const string& topic,
                                         int partition, uint64_t offset) {
     bool is_new_consumer = false;
+    bool is_ignored = false;
+    bool is_ready = false;
     {
-        lock_guard<mutex> _(consumer_offsets_mutex_);
-        consumer_offsets_[group_id][{ topic, partition }] = offset;
-        is_new_consumer = consumers_.insert(group_id).second;
+        ConsumerShard& shard = get_consumer_shard(group_id);
+        lock_guard<mutex> _(shard.mutex);
+        is_new_consumer = apply_update(shard, { group_id, topic, partition,
+                                                static_cast<int64_t>(offset), false, -1,
+                                                get_current_timestamp() },
+                                       ++version_);
+        is_ignored = is_consumer_ignored(shard, group_id);
+        // While loading, only the groups that are ready trigger notifications
+        is_ready = notifications_enabled_ &&
+                   is_partition_ready(shard.find_group(group_id)->offsets_partition);
+        // Make sure new groups can be queried by the time they're notified
+        if (is_new_consumer && is_ready) {
+            publish_shard(shard);
+        }
     }
     // If notifications aren't enabled, we're done
-    if (!notifications_enabled_) {
+    if (!is_ready || is_ignored) {
         return;
     }
 
@@ -47,16 +143,145 @@ void OffsetStore::store_consumer_offset(const string& group_id, const string& to
     }
 }
 
+void OffsetStore::remove_consumer_offset(const string& group_id, const string& topic,
+                                         int partition) {
+    ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    apply_update(shard, { group_id, topic, partition, 0, true, -1, 0 }, ++version_);
+}
+
+void OffsetStore::store_consumer_offsets(const vector<ConsumerOffsetUpdate>& updates) {
+    // Sort the updates by shard, keeping their relative order, so every shard is locked once
+    vector<pair<size_t, size_t>> shard_updates;
+    shard_updates.reserve(updates.size());
+    for (size_t i = 0; i < updates.size(); ++i) {
+        shard_updates.emplace_back(get_consumer_shard_index(updates[i].group_id), i);
+    }
+    sort(shard_updates.begin(), shard_updates.end());
+
+    // While loading, only the groups that are ready trigger notifications
+    const set<int> ready_partitions = notifications_enabled_ ?
+                                      get_ready_consumer_offsets_partitions() : set<int>();
+    vector<const ConsumerOffsetUpdate*> new_consumers;
+    vector<bool> ignored_updates(updates.size());
+    auto iter = shard_updates.begin();
+    while (iter != shard_updates.end()) {
+        ConsumerShard& shard = consumer_shards_[iter->first];
+        lock_guard<mutex> _(shard.mutex);
+        const size_t shard_index = iter->first;
+        bool notifies_new_consumers = false;
+        for (; iter != shard_updates.end() && iter->first == shard_index; ++iter) {
+            const ConsumerOffsetUpdate& update = updates[iter->second];
+            if (apply_update(shard, update, ++version_)) {
+                new_consumers.emplace_back(&update);
+                notifies_new_consumers |= notifications_enabled_ &&
+                    is_partition_ready(ready_partitions, update.offsets_partition);
+            }
+            ignored_updates[iter->second] = is_consumer_ignored(shard, update.group_id);
+        }
+        // Make sure new groups can be queried by the time they're notified
+        if (notifies_new_consumers) {
+            publish_shard(shard);
+        }
+    }
+    // If notifications aren't enabled, we're done
+    if (!notifications_enabled_) {
+        return;
+    }
+    if (!consumer_offsets_loaded_ && ready_partitions.empty()) {
+        return;
+    }
+
+    // Commit observers have a cool down so go backwards to make sure the latest commit for
+    // each group is the one that's notified
+    vector<ConsumerOffset> commits;
+    for (size_t i = updates.size(); i > 0; --i) {
+        const ConsumerOffsetUpdate& update = updates[i - 1];
+        if (update.removed || ignored_updates[i - 1] ||
+            !is_partition_ready(ready_partitions, update.offsets_partition)) {
+            continue;
+        }
+        consumer_commit_observer_.notify(update.group_id, update.topic, update.partition,
+                                         update.offset);
+        commits.emplace_back(update.group_id, update.topic, update.partition, update.offset);
+    }
+    for (const ConsumerOffsetUpdate* update : new_consumers) {
+        if (is_partition_ready(ready_partitions, update->offsets_partition)) {
+            new_string_observer_.notify(NEW_CONSUMER_ID, update->group_id);
+        }
+    }
+    if (!commits.empty()) {
+        // Restore the original order
+        reverse(commits.begin(), commits.end());
+        commit_batch_observer_.notify(COMMIT_BATCH_ID, commits);
+    }
+}
+
+void OffsetStore::store_consumer_group_state(const string& group_id,
+                                             ConsumerGroupState state) {
+    ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    // Dead groups are only remembered while they still have offsets
+    if (state == ConsumerGroupState::DEAD && !shard.group_ids->count(group_id)) {
+        on_consumer_state_change(shard, group_id, ConsumerGroupState::UNKNOWN);
+        shard.consumer_states.erase(group_id);
+    }
+    else {
+        on_consumer_state_change(shard, group_id, state);
+        shard.consumer_states[group_id] = state;
+    }
+}
+
 void OffsetStore::store_topic_offset(const string& topic, int partition,
                                      uint64_t offset) {
     bool is_new_topic = false;
     bool is_new_offset = false;
+    if (partition < 0) {
+        return;
+    }
     {
-        lock_guard<mutex> _(topic_offsets_mutex_);
-        int64_t& existing_offset = topic_offsets_[{topic, partition}];
-        is_new_offset = existing_offset != static_cast<int64_t>(offset);
-        is_new_topic = topics_.emplace(topic).second;
-        existing_offset = offset;
+        TopicShard& shard = get_topic_shard(topic);
+        lock_guard<mutex> _(shard.mutex);
+        auto iter = shard.topic_offsets.find(topic);
+        if (iter == shard.topic_offsets.end()) {
+            iter = shard.topic_offsets.emplace(
+                topic, CopyOnWrite<TopicOffsets>(TopicOffsets(), shard.generation)
+            ).first;
+            is_new_topic = true;
+        }
+        // Unchanged watermarks are sampled too so it's known the topic was idle
+        if (history_size_ > 0) {
+            auto& partition_histories = shard.topic_histories[topic];
+            auto history_iter = partition_histories.find(partition);
+            if (history_iter == partition_histories.end()) {
+                OffsetHistory history(history_size_);
+                if (reserve_history(history)) {
+                    history_iter = partition_histories.emplace(partition, move(history)).first;
+                }
+            }
+            if (history_iter != partition_histories.end()) {
+                history_iter->second.add_sample(get_current_timestamp(), offset);
+            }
+        }
+        // Unchanged watermarks leave the published offsets alone
+        const vector<int64_t>& current_offsets = iter->second->offsets;
+        is_new_offset = static_cast<size_t>(partition) >= current_offsets.size() ||
+                        current_offsets[partition] != static_cast<int64_t>(offset);
+        if (is_new_offset) {
+            // Log the topic the first time it changes on this generation
+            if (iter->second->version <= shard.view_version) {
+                shard.pending_changed_topics.emplace_back(topic);
+            }
+            TopicOffsets& topic_offsets = iter->second.get_mutable(shard.generation);
+            if (static_cast<size_t>(partition) >= topic_offsets.offsets.size()) {
+                topic_offsets.offsets.resize(partition + 1, NO_OFFSET);
+                topic_offsets.versions.resize(partition + 1, 0);
+            }
+            topic_offsets.offsets[partition] = offset;
+            topic_offsets.versions[partition] = ++version_;
+            topic_offsets.version = topic_offsets.versions[partition];
+            shard.dirty = true;
+        }
     }
     // If notifications aren't enabled, we're done
     if (!notifications_enabled_) {
@@ -71,6 +296,135 @@ void OffsetStore::store_topic_offset(const string& topic, int partition,
     }
 }
 
+void OffsetStore::store_message_timestamp(const string& topic, int partition, int64_t offset,
+                                          int64_t timestamp) {
+    TopicShard& shard = get_topic_shard(topic);
+    lock_guard<mutex> _(shard.mutex);
+    TimestampBucketMap& buckets = shard.message_timestamps[topic][partition];
+    buckets[offset / timestamp_bucket_size_] = timestamp;
+    if (buckets.size() > MAXIMUM_TIMESTAMP_BUCKETS) {
+        buckets.erase(buckets.begin());
+    }
+}
+
+vector<string> OffsetStore::remove_inactive_consumers(milliseconds ttl) {
+    const int64_t horizon = get_current_timestamp() - ttl.count();
+    vector<string> output;
+    for (ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        const size_t first = output.size();
+        for (const auto& group : shard.groups) {
+            if (group->commit_timestamp < horizon) {
+                output.emplace_back(group->group_id);
+            }
+        }
+        for (size_t i = first; i < output.size(); ++i) {
+            remove_consumer_offsets(shard, output[i], nullptr);
+            on_consumer_state_change(shard, output[i], ConsumerGroupState::UNKNOWN);
+            shard.consumer_states.erase(output[i]);
+            // Handlers subscribe again once the group comes back and is announced as new
+            consumer_commit_observer_.unobserve(output[i]);
+        }
+    }
+    return output;
+}
+
+void OffsetStore::remove_topic(const string& topic) {
+    // Hold every consumer shard until the topic is gone, otherwise a commit landing after
+    // its consumers are collected would bring its offsets back. Consumer shards are locked
+    // before topic shards, always in the same order
+    vector<unique_lock<mutex>> consumer_locks;
+    consumer_locks.reserve(consumer_shards_.size());
+    for (ConsumerShard& shard : consumer_shards_) {
+        consumer_locks.emplace_back(shard.mutex);
+    }
+    vector<string> consumers;
+    {
+        const TopicShard& shard = get_topic_shard(topic);
+        lock_guard<mutex> _(shard.mutex);
+        auto iter = shard.topic_consumers.find(topic);
+        if (iter != shard.topic_consumers.end()) {
+            for (const auto& consumer_pair : *iter->second) {
+                consumers.emplace_back(consumer_pair.first);
+            }
+        }
+    }
+    // The topic shard has to be released first, removing offsets locks it
+    for (const string& group_id : consumers) {
+        remove_consumer_offsets(get_consumer_shard(group_id), group_id, &topic);
+    }
+    {
+        TopicShard& shard = get_topic_shard(topic);
+        lock_guard<mutex> _(shard.mutex);
+        auto history_iter = shard.topic_histories.find(topic);
+        if (history_iter != shard.topic_histories.end()) {
+            for (const auto& history_pair : history_iter->second) {
+                release_history(history_pair.second);
+            }
+            shard.topic_histories.erase(history_iter);
+        }
+        shard.message_timestamps.erase(topic);
+        if (shard.topic_offsets.erase(topic)) {
+            auto& removed_topics = shard.removed_topics.get_mutable(shard.generation);
+            removed_topics.push_back({ topic, ++version_ });
+            if (removed_topics.size() > MAXIMUM_REMOVED_OFFSETS) {
+                shard.removal_horizon = removed_topics.front().version;
+                removed_topics.pop_front();
+            }
+            shard.dirty = true;
+        }
+    }
+    consumer_locks.clear();
+    topic_message_observer_.unobserve(topic);
+}
+
+void OffsetStore::set_consumer_offsets_position(int partition, int64_t offset) {
+    lock_guard<mutex> _(positions_mutex_);
+    consumer_offsets_positions_[partition] = offset;
+}
+
+void OffsetStore::set_consumer_offsets_partition_ready(int partition) {
+    set_consumer_offsets_partitions_ready({ partition });
+}
+
+void OffsetStore::set_consumer_offsets_partitions_ready(const vector<int>& partitions) {
+    set<int> new_partitions;
+    {
+        lock_guard<mutex> _(positions_mutex_);
+        for (int partition : partitions) {
+            if (ready_partitions_.emplace(partition).second) {
+                new_partitions.emplace(partition);
+            }
+        }
+    }
+    if (new_partitions.empty() || !notifications_enabled_ || consumer_offsets_loaded_) {
+        return;
+    }
+    // Notifications for these groups were held back until now
+    vector<string> ready_consumers;
+    for (ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        const size_t first = ready_consumers.size();
+        for (const auto& group : shard.groups) {
+            if (new_partitions.count(group->offsets_partition)) {
+                ready_consumers.emplace_back(group->group_id);
+            }
+        }
+        // Make sure these groups can be queried by the time they're notified
+        if (ready_consumers.size() != first) {
+            publish_shard(shard);
+        }
+    }
+    for (const string& group_id : ready_consumers) {
+        new_string_observer_.notify(NEW_CONSUMER_ID, group_id);
+    }
+}
+
+void OffsetStore::set_consumer_offsets_loaded() {
+    publish();
+    consumer_offsets_loaded_ = true;
+}
+
 void OffsetStore::on_new_consumer(ConsumerCallback callback) {
     new_string_observer_.observe(NEW_CONSUMER_ID, [=](int, const string& group_id) {
         callback(group_id);
@@ -83,8 +437,16 @@ void OffsetStore::on_new_topic(TopicCallback callback) {
     });
 }
 
-void OffsetStore::on_consumer_commit(const string& group_id, ConsumerCommitCallback callback) {
-    consumer_commit_observer_.observe(group_id, move(callback));
+void OffsetStore::on_consumer_commit(const string& group_id, ConsumerCommitCallback callback,
+                                     const void* owner) {
+    consumer_commit_observer_.observe(group_id, move(callback), owner);
+}
+
+void OffsetStore::on_consumer_commit_batch(ConsumerCommitBatchCallback callback) {
+    commit_batch_observer_.observe(COMMIT_BATCH_ID, [=](int,
+                                                        const vector<ConsumerOffset>& commits) {
+        callback(commits);
+    });
 }
 
 void OffsetStore::on_topic_message(const string& topic, TopicMessageCallback callback) {
@@ -95,40 +457,1347 @@ void OffsetStore::enable_notifications() {
     notifications_enabled_ = true;
 }
 
+void OffsetStore::set_ignore_inactive_consumers(bool ignore) {
+    ignore_inactive_consumers_ = ignore;
+}
+
+void OffsetStore::set_lag_rollups_enabled(bool enabled) {
+    {
+        lock_guard<mutex> _(lag_rollups_mutex_);
+        // State changes are tracked from now on, so none is missed while starting over
+        lag_rollups_enabled_ = enabled;
+        lag_rollups_version_ = 0;
+        if (!enabled) {
+            lag_rollups_.clear();
+            return;
+        }
+        reset_lag_rollups();
+    }
+    update_lag_rollups();
+}
+
+void OffsetStore::set_history_size(size_t size) {
+    history_size_ = size;
+}
+
+void OffsetStore::set_maximum_history_size(size_t size) {
+    maximum_history_size_ = size;
+}
+
+void OffsetStore::set_message_timestamp_bucket_size(int64_t size) {
+    timestamp_bucket_size_ = max<int64_t>(size, 1);
+}
+
+void OffsetStore::set_publish_interval(milliseconds interval) {
+    {
+        lock_guard<mutex> _(publisher_mutex_);
+        publish_interval_ = interval;
+    }
+    publisher_condition_.notify_one();
+}
+
+void OffsetStore::publish() {
+    for (ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        publish_shard(shard);
+    }
+    for (TopicShard& shard : topic_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        publish_shard(shard);
+    }
+    update_lag_rollups();
+}
+
 vector<string> OffsetStore::get_consumers() const {
     vector<string> output;
-    lock_guard<mutex> _(consumer_offsets_mutex_);
-    for (const auto& consumer_pair : consumer_offsets_) {
-        output.emplace_back(consumer_pair.first);
+    for (const ConsumerShard& shard : consumer_shards_) {
+        for (const auto& group : get_view(shard)->groups) {
+            output.emplace_back(group->group_id);
+        }
     }
     return output;
 }
 
+optional<int> OffsetStore::get_consumer_offsets_partition(const string& group_id) const {
+    const ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    const ConsumerGroup* group = shard.find_group(group_id);
+    if (!group || group->offsets_partition == -1) {
+        return boost::none;
+    }
+    return group->offsets_partition;
+}
+
+int64_t OffsetStore::get_consumer_commit_timestamp(const string& group_id) const {
+    const ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    const ConsumerGroup* group = shard.find_group(group_id);
+    return group ? group->commit_timestamp : 0;
+}
+
+bool OffsetStore::is_consumer_ready(const string& group_id) const {
+    if (consumer_offsets_loaded_) {
+        return true;
+    }
+    const optional<int> offsets_partition = get_consumer_offsets_partition(group_id);
+    return offsets_partition &&
+           is_partition_ready(get_ready_consumer_offsets_partitions(), *offsets_partition);
+}
+
+bool OffsetStore::is_consumer_offsets_loaded() const {
+    return consumer_offsets_loaded_;
+}
+
+OffsetStore::ConsumerGroupState OffsetStore::get_consumer_state(const string& group_id) const {
+    const ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    auto iter = shard.consumer_states.find(group_id);
+    return iter != shard.consumer_states.end() ? iter->second : ConsumerGroupState::UNKNOWN;
+}
+
+map<string, OffsetStore::ConsumerGroupState> OffsetStore::get_consumer_states() const {
+    map<string, ConsumerGroupState> output;
+    for (const ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        output.insert(shard.consumer_states.begin(), shard.consumer_states.end());
+    }
+    return output;
+}
+
+bool OffsetStore::is_consumer_active(const string& group_id) const {
+    return is_active_state(get_consumer_state(group_id));
+}
+
+bool OffsetStore::is_consumer_ignored(const string& group_id) const {
+    const ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    return is_consumer_ignored(shard, group_id);
+}
+
+set<int> OffsetStore::get_ready_consumer_offsets_partitions() const {
+    lock_guard<mutex> _(positions_mutex_);
+    return ready_partitions_;
+}
+
 vector<ConsumerOffset> OffsetStore::get_consumer_offsets(const string& group_id) const {
-    lock_guard<mutex> _(consumer_offsets_mutex_);
-    auto iter = consumer_offsets_.find(group_id);
-    if (iter == consumer_offsets_.end()) {
+    const auto view = get_view(get_consumer_shard(group_id));
+    const ConsumerGroup* group = view->find_group(group_id);
+    if (!group) {
         return {};
     }
     vector<ConsumerOffset> output;
-    for (const auto& topic_pair : iter->second) {
-        output.emplace_back(group_id, topic_pair.first.get_topic(),
-                            topic_pair.first.get_partition(), topic_pair.second);
+    output.reserve(group->offsets.size());
+    for (const PartitionOffset& entry : group->offsets) {
+        output.emplace_back(group_id, view->get_topic_name(entry.topic_id), entry.partition,
+                            entry.offset);
     }
     return output;
 }
 
 optional<int64_t> OffsetStore::get_topic_offset(const string& topic, int partition) const {
-    lock_guard<mutex> _(topic_offsets_mutex_);
-    auto iter = topic_offsets_.find({ topic, partition });
-    if (iter == topic_offsets_.end()) {
+    const auto view = get_view(get_topic_shard(topic));
+    auto iter = view->topic_offsets.find(topic);
+    if (iter == view->topic_offsets.end() || partition < 0 ||
+        static_cast<size_t>(partition) >= iter->second->offsets.size() ||
+        iter->second->offsets[partition] == NO_OFFSET) {
         return boost::none;
     }
-    return iter->second;
+    return iter->second->offsets[partition];
 }
 
 vector<string> OffsetStore::get_topics() const {
-    return vector<string>(topics_.begin(), topics_.end());
+    vector<string> output;
+    for (const TopicShard& shard : topic_shards_) {
+        for (const auto& topic_pair : get_view(shard)->topic_offsets) {
+            output.emplace_back(topic_pair.first);
+        }
+    }
+    return output;
+}
+
+vector<string> OffsetStore::get_topic_consumers(const string& topic) const {
+    const auto view = get_view(get_topic_shard(topic));
+    auto iter = view->topic_consumers.find(topic);
+    if (iter == view->topic_consumers.end()) {
+        return {};
+    }
+    vector<string> output;
+    for (const auto& consumer_pair : *iter->second) {
+        output.emplace_back(consumer_pair.first);
+    }
+    return output;
+}
+
+vector<ConsumerOffset> OffsetStore::get_topic_consumer_offsets(const string& topic) const {
+    vector<ConsumerOffset> output;
+    visit_topic_consumer_offsets(topic, [&](const ConsumerGroup& group,
+                                            const PartitionOffset& entry) {
+        output.emplace_back(group.group_id, topic, entry.partition, entry.offset);
+    });
+    return output;
+}
+
+vector<ConsumerOffset> OffsetStore::get_topic_consumer_offsets(const string& topic,
+                                                               int partition) const {
+    vector<ConsumerOffset> output;
+    visit_topic_consumer_offsets(topic, [&](const ConsumerGroup& group,
+                                            const PartitionOffset& entry) {
+        if (entry.partition == partition) {
+            output.emplace_back(group.group_id, topic, entry.partition, entry.offset);
+        }
+    });
+    return output;
+}
+
+vector<ConsumerOffset> OffsetStore::get_ready_topic_consumer_offsets(const string& topic,
+                                                                     int partition) const {
+    // The ready partitions are only needed while loading
+    const set<int> ready_partitions = consumer_offsets_loaded_ ?
+                                      set<int>() : get_ready_consumer_offsets_partitions();
+    const bool ignore_inactive = ignore_inactive_consumers_;
+    vector<ConsumerOffset> output;
+    visit_topic_consumer_offsets(topic, [&](const ConsumerGroup& group,
+                                            const PartitionOffset& entry) {
+        if (entry.partition != partition || (ignore_inactive && !group.is_active) ||
+            !is_partition_ready(ready_partitions, group.offsets_partition)) {
+            return;
+        }
+        output.emplace_back(group.group_id, topic, entry.partition, entry.offset);
+    });
+    return output;
+}
+
+vector<TopicPartition> OffsetStore::get_topic_offsets() const {
+    vector<TopicPartition> output;
+    for (const TopicShard& shard : topic_shards_) {
+        for (const auto& topic_pair : get_view(shard)->topic_offsets) {
+            const vector<int64_t>& offsets = topic_pair.second->offsets;
+            for (size_t partition = 0; partition < offsets.size(); ++partition) {
+                if (offsets[partition] != NO_OFFSET) {
+                    output.emplace_back(topic_pair.first, partition, offsets[partition]);
+                }
+            }
+        }
+    }
+    sort(output.begin(), output.end());
+    return output;
+}
+
+map<int, int64_t> OffsetStore::get_consumer_offsets_positions() const {
+    lock_guard<mutex> _(positions_mutex_);
+    return consumer_offsets_positions_;
+}
+
+optional<int64_t> OffsetStore::get_consumer_offsets_position(int partition) const {
+    lock_guard<mutex> _(positions_mutex_);
+    auto iter = consumer_offsets_positions_.find(partition);
+    if (iter == consumer_offsets_positions_.end()) {
+        return boost::none;
+    }
+    return iter->second;
+}
+
+OffsetStore::ChangeSet OffsetStore::changes_since(Version version) const {
+    ChangeSet output{ numeric_limits<Version>::max(), false, {}, {}, {}, {} };
+    // Views are loaded after their versions, so they contain at least everything up to them.
+    // The oldest of those versions is the one everything has been seen up to
+    vector<shared_ptr<const ConsumerShardData>> consumer_views;
+    for (const ConsumerShard& shard : consumer_shards_) {
+        output.version = min<Version>(output.version, shard.view_version);
+        consumer_views.emplace_back(get_view(shard));
+        if (version < consumer_views.back()->removal_horizon) {
+            output.reset = true;
+        }
+    }
+    vector<shared_ptr<const TopicShardData>> topic_views;
+    for (const TopicShard& shard : topic_shards_) {
+        output.version = min<Version>(output.version, shard.view_version);
+        topic_views.emplace_back(get_view(shard));
+        if (version < topic_views.back()->removal_horizon) {
+            output.reset = true;
+        }
+    }
+    // Versions start at the current time, so a version from before a restart can be ahead
+    // of this store's
+    if (version > output.version) {
+        output.reset = true;
+    }
+    if (output.reset) {
+        version = 0;
+    }
+
+    // Groups and topics keep the latest version they changed at so the unchanged ones are
+    // skipped without looking at their offsets
+    auto add_group_offsets = [&](const ConsumerShardData& view, const ConsumerGroup& group) {
+        if (group.version <= version) {
+            return;
+        }
+        for (const PartitionOffset& entry : group.offsets) {
+            if (entry.version > version) {
+                output.consumer_offsets.emplace_back(group.group_id,
+                                                     view.get_topic_name(entry.topic_id),
+                                                     entry.partition, entry.offset);
+            }
+        }
+    };
+    auto add_topic_offsets = [&](const string& topic, const TopicOffsets& topic_offsets) {
+        if (topic_offsets.version <= version) {
+            return;
+        }
+        for (size_t partition = 0; partition < topic_offsets.offsets.size(); ++partition) {
+            if (topic_offsets.versions[partition] > version) {
+                output.topic_offsets.emplace_back(topic, partition,
+                                                  topic_offsets.offsets[partition]);
+            }
+        }
+    };
+    // Unless the changes are older than what the logs remember, only the groups and topics
+    // logged after the version are looked at
+    vector<GroupId> group_ids;
+    for (const auto& view : consumer_views) {
+        if (version == 0 || version < view->change_horizon) {
+            for (const auto& group : view->groups) {
+                add_group_offsets(*view, *group);
+            }
+        }
+        else {
+            group_ids.clear();
+            for (auto iter = view->changed_groups->rbegin();
+                 iter != view->changed_groups->rend() && iter->version > version; ++iter) {
+                group_ids.insert(group_ids.end(), iter->ids->begin(), iter->ids->end());
+            }
+            sort(group_ids.begin(), group_ids.end());
+            group_ids.erase(unique(group_ids.begin(), group_ids.end()), group_ids.end());
+            // Ids logged before a group was removed may be gone or belong to another group
+            for (GroupId group_id : group_ids) {
+                if (group_id < view->groups.size()) {
+                    add_group_offsets(*view, *view->groups[group_id]);
+                }
+            }
+        }
+        // Removals are sorted by version so go backwards until the old ones show up
+        for (auto iter = view->removed_offsets->rbegin();
+             iter != view->removed_offsets->rend() && iter->version > version; ++iter) {
+            output.removed_consumer_offsets.emplace_back(iter->group_id,
+                                                         view->get_topic_name(iter->topic_id),
+                                                         iter->partition, 0);
+        }
+    }
+    vector<const string*> topics;
+    for (const auto& view : topic_views) {
+        if (version == 0 || version < view->change_horizon) {
+            for (const auto& topic_pair : view->topic_offsets) {
+                add_topic_offsets(topic_pair.first, *topic_pair.second);
+            }
+        }
+        else {
+            topics.clear();
+            for (auto iter = view->changed_topics->rbegin();
+                 iter != view->changed_topics->rend() && iter->version > version; ++iter) {
+                for (const string& topic : *iter->ids) {
+                    topics.emplace_back(&topic);
+                }
+            }
+            auto by_name = [](const string* lhs, const string* rhs) { return *lhs < *rhs; };
+            auto same_name = [](const string* lhs, const string* rhs) { return *lhs == *rhs; };
+            sort(topics.begin(), topics.end(), by_name);
+            topics.erase(unique(topics.begin(), topics.end(), same_name), topics.end());
+            // Logged topics may have been removed since
+            for (const string* topic : topics) {
+                auto iter = view->topic_offsets.find(*topic);
+                if (iter != view->topic_offsets.end()) {
+                    add_topic_offsets(iter->first, *iter->second);
+                }
+            }
+        }
+        for (auto iter = view->removed_topics->rbegin();
+             iter != view->removed_topics->rend() && iter->version > version; ++iter) {
+            output.removed_topics.emplace_back(iter->topic);
+        }
+    }
+    return output;
+}
+
+OffsetStore::OffsetSamples OffsetStore::get_topic_offset_history(const string& topic,
+                                                                 int partition, int64_t start,
+                                                                 int64_t end) const {
+    const TopicShard& shard = get_topic_shard(topic);
+    lock_guard<mutex> _(shard.mutex);
+    auto topic_iter = shard.topic_histories.find(topic);
+    if (topic_iter == shard.topic_histories.end()) {
+        return {};
+    }
+    auto history_iter = topic_iter->second.find(partition);
+    if (history_iter == topic_iter->second.end()) {
+        return {};
+    }
+    return history_iter->second.get_samples(start, end);
+}
+
+OffsetStore::OffsetSamples OffsetStore::get_consumer_offset_history(const string& group_id,
+                                                                    const string& topic,
+                                                                    int partition,
+                                                                    int64_t start,
+                                                                    int64_t end) const {
+    const ConsumerShard& shard = get_consumer_shard(group_id);
+    lock_guard<mutex> _(shard.mutex);
+    auto group_iter = shard.consumer_histories.find(group_id);
+    const TopicId* topic_id = shard.find_topic_id(topic);
+    if (group_iter == shard.consumer_histories.end() || !topic_id) {
+        return {};
+    }
+    auto history_iter = group_iter->second.find({ *topic_id, partition });
+    if (history_iter == group_iter->second.end()) {
+        return {};
+    }
+    return history_iter->second.get_samples(start, end);
+}
+
+optional<int64_t> OffsetStore::get_message_timestamp(const string& topic, int partition,
+                                                     int64_t offset) const {
+    const TopicShard& shard = get_topic_shard(topic);
+    lock_guard<mutex> _(shard.mutex);
+    return find_message_timestamp(shard, topic, partition, offset);
+}
+
+optional<milliseconds> OffsetStore::get_time_lag(const string& topic, int partition,
+                                                int64_t offset) const {
+    optional<int64_t> timestamp;
+    {
+        const TopicShard& shard = get_topic_shard(topic);
+        lock_guard<mutex> _(shard.mutex);
+        auto offsets_iter = shard.topic_offsets.find(topic);
+        if (offsets_iter == shard.topic_offsets.end() || partition < 0 ||
+            static_cast<size_t>(partition) >= offsets_iter->second->offsets.size() ||
+            offsets_iter->second->offsets[partition] == NO_OFFSET) {
+            return boost::none;
+        }
+        if (offset >= offsets_iter->second->offsets[partition]) {
+            return milliseconds(0);
+        }
+        timestamp = find_message_timestamp(shard, topic, partition, offset);
+        if (!timestamp) {
+            auto topic_iter = shard.topic_histories.find(topic);
+            if (topic_iter == shard.topic_histories.end()) {
+                return boost::none;
+            }
+            auto history_iter = topic_iter->second.find(partition);
+            if (history_iter == topic_iter->second.end()) {
+                return boost::none;
+            }
+            timestamp = history_iter->second.find_timestamp(offset);
+        }
+    }
+    if (!timestamp) {
+        return boost::none;
+    }
+    return milliseconds(max<int64_t>(0, get_current_timestamp() - *timestamp));
+}
+
+optional<milliseconds> OffsetStore::get_consumer_time_lag(const string& group_id,
+                                                         const string& topic,
+                                                         int partition) const {
+    const auto view = get_view(get_consumer_shard(group_id));
+    const ConsumerGroup* group = view->find_group(group_id);
+    const TopicId* topic_id = view->find_topic_id(topic);
+    if (!group || !topic_id) {
+        return boost::none;
+    }
+    const PartitionOffset entry{ *topic_id, partition, 0, 0 };
+    auto offset_iter = lower_bound(group->offsets.begin(), group->offsets.end(), entry);
+    if (offset_iter == group->offsets.end() || entry < *offset_iter) {
+        return boost::none;
+    }
+    return get_time_lag(topic, partition, offset_iter->offset);
+}
+
+OffsetStore::LagColumns OffsetStore::compute_all_lags() const {
+    static const uint32_t NO_INDEX = numeric_limits<uint32_t>::max();
+    LagColumns output;
+    // Topic names are interned, so every shard points to the same copy of each
+    unordered_map<const string*, uint32_t> topic_indexes;
+    vector<uint32_t> shard_group_indexes;
+    vector<uint32_t> shard_topic_indexes;
+    visit_shard_lags([&](const shared_ptr<const ConsumerShardData>& view,
+                         const ShardLags& lags) {
+        if (lags.lags.empty()) {
+            return;
+        }
+        output.views.emplace_back(view);
+        // Shards have their own group and topic ids, map them to the output's indexes
+        shard_group_indexes.assign(view->groups.size(), NO_INDEX);
+        shard_topic_indexes.assign(view->topic_names->size(), NO_INDEX);
+        for (size_t i = 0; i < lags.lags.size(); ++i) {
+            uint32_t& group_index = shard_group_indexes[lags.group_indexes[i]];
+            if (group_index == NO_INDEX) {
+                group_index = output.group_ids.size();
+                output.group_ids.emplace_back(&view->groups[lags.group_indexes[i]]->group_id);
+            }
+            uint32_t& topic_index = shard_topic_indexes[lags.topic_ids[i]];
+            if (topic_index == NO_INDEX) {
+                const string* topic = &view->get_topic_name(lags.topic_ids[i]);
+                auto iter = topic_indexes.emplace(topic, output.topics.size()).first;
+                if (iter->second == output.topics.size()) {
+                    output.topics.emplace_back(topic);
+                }
+                topic_index = iter->second;
+            }
+            output.group_indexes.emplace_back(group_index);
+            output.topic_indexes.emplace_back(topic_index);
+        }
+        output.partitions.insert(output.partitions.end(), lags.partitions.begin(),
+                                 lags.partitions.end());
+        output.consumer_offsets.insert(output.consumer_offsets.end(),
+                                       lags.consumer_offsets.begin(),
+                                       lags.consumer_offsets.end());
+        output.topic_offsets.insert(output.topic_offsets.end(), lags.topic_offsets.begin(),
+                                    lags.topic_offsets.end());
+        output.lags.insert(output.lags.end(), lags.lags.begin(), lags.lags.end());
+    });
+    return output;
+}
+
+void OffsetStore::visit_all_lags(const LagCallback& callback) const {
+    visit_shard_lags([&](const shared_ptr<const ConsumerShardData>& view,
+                         const ShardLags& lags) {
+        for (size_t i = 0; i < lags.lags.size(); ++i) {
+            callback(view->groups[lags.group_indexes[i]]->group_id,
+                     view->get_topic_name(lags.topic_ids[i]), lags.partitions[i],
+                     lags.consumer_offsets[i], lags.topic_offsets[i], lags.lags[i]);
+        }
+    });
+}
+
+optional<LagRollups::Rollup> OffsetStore::get_consumer_lag(const string& group_id) const {
+    return lag_rollups_.get_consumer_lag(group_id);
+}
+
+optional<LagRollups::Rollup> OffsetStore::get_consumer_lag(const string& group_id,
+                                                           const string& topic) const {
+    return lag_rollups_.get_consumer_lag(group_id, topic);
+}
+
+optional<int64_t> OffsetStore::get_consumer_max_lag(const string& group_id,
+                                                    const string& topic) const {
+    return lag_rollups_.get_consumer_max_lag(group_id, topic);
+}
+
+optional<LagRollups::Rollup> OffsetStore::get_topic_lag(const string& topic) const {
+    return lag_rollups_.get_topic_lag(topic);
+}
+
+vector<LagRollups::PartitionLag> OffsetStore::get_largest_partition_lags(size_t count) const {
+    return lag_rollups_.get_largest_partition_lags(count);
+}
+
+vector<LagRollups::GroupLag> OffsetStore::get_largest_consumer_lags(size_t count) const {
+    return lag_rollups_.get_largest_consumer_lags(count);
+}
+
+vector<MemoryUsage> OffsetStore::get_memory_usage() const {
+    using memory::get_heap_size;
+
+    vector<MemoryUsage> output;
+    // Views share their contents with the shards, only their tables are their own
+    size_t view_bytes = 0;
+    for (const ConsumerShard& shard : consumer_shards_) {
+        {
+            lock_guard<mutex> _(shard.mutex);
+            add_memory_usage(static_cast<const ConsumerShardData&>(shard), output);
+            size_t state_bytes = get_heap_size(shard.consumer_states);
+            for (const auto& state_pair : shard.consumer_states) {
+                state_bytes += get_heap_size(state_pair.first);
+            }
+            add_usage(output, "consumer states", shard.consumer_states.size(), state_bytes);
+            size_t series_count = 0;
+            size_t history_bytes = get_heap_size(shard.consumer_histories);
+            for (const auto& group_pair : shard.consumer_histories) {
+                history_bytes += get_heap_size(group_pair.first) +
+                                 get_heap_size(group_pair.second);
+                for (const auto& history_pair : group_pair.second) {
+                    history_bytes += history_pair.second.get_size();
+                }
+                series_count += group_pair.second.size();
+            }
+            add_usage(output, "consumer offset history", series_count, history_bytes);
+        }
+        view_bytes += get_heap_size(get_view(shard)->groups);
+    }
+    for (const TopicShard& shard : topic_shards_) {
+        {
+            lock_guard<mutex> _(shard.mutex);
+            add_memory_usage(static_cast<const TopicShardData&>(shard), output);
+            size_t series_count = 0;
+            size_t history_bytes = get_heap_size(shard.topic_histories);
+            for (const auto& topic_pair : shard.topic_histories) {
+                history_bytes += get_heap_size(topic_pair.first) +
+                                 get_heap_size(topic_pair.second);
+                for (const auto& history_pair : topic_pair.second) {
+                    history_bytes += history_pair.second.get_size();
+                }
+                series_count += topic_pair.second.size();
+            }
+            add_usage(output, "topic offset history", series_count, history_bytes);
+            size_t bucket_count = 0;
+            size_t timestamp_bytes = get_heap_size(shard.message_timestamps);
+            for (const auto& topic_pair : shard.message_timestamps) {
+                timestamp_bytes += get_heap_size(topic_pair.first) +
+                                   get_heap_size(topic_pair.second);
+                for (const auto& partition_pair : topic_pair.second) {
+                    timestamp_bytes += get_heap_size(partition_pair.second);
+                    bucket_count += partition_pair.second.size();
+                }
+            }
+            add_usage(output, "message timestamps", bucket_count, timestamp_bytes);
+        }
+        const auto view = get_view(shard);
+        view_bytes += get_heap_size(view->topic_offsets) + get_heap_size(view->topic_consumers);
+        for (const auto& topic_pair : view->topic_offsets) {
+            view_bytes += get_heap_size(topic_pair.first);
+        }
+        for (const auto& topic_pair : view->topic_consumers) {
+            view_bytes += get_heap_size(topic_pair.first);
+        }
+    }
+    add_usage(output, "published views", consumer_shards_.size() + topic_shards_.size(),
+              view_bytes);
+    add_usage(output, "observers",
+              new_string_observer_.get_observed_count() +
+              consumer_commit_observer_.get_observed_count() +
+              topic_message_observer_.get_observed_count() +
+              commit_batch_observer_.get_observed_count(),
+              new_string_observer_.get_memory_usage() +
+              consumer_commit_observer_.get_memory_usage() +
+              topic_message_observer_.get_memory_usage() +
+              commit_batch_observer_.get_memory_usage());
+    add_usage(output, "topic names", topic_names_.size(), topic_names_.get_memory_usage());
+    add_usage(output, "lag rollups", lag_rollups_.get_offset_count(),
+              lag_rollups_.get_memory_usage());
+    // Not memory in use but what the history series can grow up to, which is what's capped
+    add_usage(output, "reserved offset history", history_series_count_,
+              reserved_history_size_);
+    return output;
+}
+
+vector<MemoryUsage> OffsetStore::get_largest_consumers(size_t count) const {
+    vector<MemoryUsage> output;
+    for (const ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        for (const auto& group_ptr : shard.groups) {
+            const ConsumerGroup& group = *group_ptr;
+            size_t bytes = get_consumer_size(group);
+            auto history_iter = shard.consumer_histories.find(group.group_id);
+            if (history_iter != shard.consumer_histories.end()) {
+                bytes += memory::get_heap_size(history_iter->second);
+                for (const auto& history_pair : history_iter->second) {
+                    bytes += history_pair.second.get_size();
+                }
+            }
+            output.push_back({ group.group_id, group.offsets.size(), bytes });
+        }
+        // Don't let this grow with the amount of groups
+        if (output.size() > count * 2) {
+            keep_largest(output, count);
+        }
+    }
+    keep_largest(output, count);
+    return output;
+}
+
+vector<MemoryUsage> OffsetStore::get_largest_topics(size_t count) const {
+    vector<MemoryUsage> output;
+    for (const TopicShard& shard : topic_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        for (const auto& topic_pair : shard.topic_offsets) {
+            output.push_back({ topic_pair.first, topic_pair.second->offsets.size(),
+                               get_topic_size(shard, topic_pair.first) });
+        }
+        if (output.size() > count * 2) {
+            keep_largest(output, count);
+        }
+    }
+    keep_largest(output, count);
+    return output;
+}
+
+bool OffsetStore::apply_update(ConsumerShard& shard, const ConsumerOffsetUpdate& update,
+                               Version version) {
+    shard.dirty = true;
+    auto iter = shard.group_ids->find(update.group_id);
+    if (update.removed) {
+        if (iter == shard.group_ids->end()) {
+            return false;
+        }
+        const GroupId group_id = iter->second;
+        const TopicId* topic_id = shard.find_topic_id(update.topic);
+        if (topic_id) {
+            const PartitionOffset entry{ *topic_id, update.partition, 0, 0 };
+            const vector<PartitionOffset>& current_offsets = shard.groups[group_id]->offsets;
+            auto offset_iter = lower_bound(current_offsets.begin(), current_offsets.end(),
+                                           entry);
+            if (offset_iter != current_offsets.end() && !(entry < *offset_iter)) {
+                const size_t index = offset_iter - current_offsets.begin();
+                vector<PartitionOffset>& offsets = shard.get_mutable_group(group_id).offsets;
+                offsets.erase(offsets.begin() + index);
+                remove_topic_consumer(update.topic, update.group_id);
+                auto history_iter = shard.consumer_histories.find(update.group_id);
+                if (history_iter != shard.consumer_histories.end()) {
+                    auto series_iter = history_iter->second.find({ entry.topic_id,
+                                                                   entry.partition });
+                    if (series_iter != history_iter->second.end()) {
+                        release_history(series_iter->second);
+                        history_iter->second.erase(series_iter);
+                    }
+                }
+                // The removal takes over the offset's reference to its topic id
+                auto& removed_offsets = shard.removed_offsets.get_mutable(shard.generation);
+                removed_offsets.push_back({ update.group_id, entry.topic_id, update.partition,
+                                            version });
+                if (removed_offsets.size() > MAXIMUM_REMOVED_OFFSETS) {
+                    shard.removal_horizon = removed_offsets.front().version;
+                    shard.remove_topic_reference(removed_offsets.front().topic_id);
+                    removed_offsets.pop_front();
+                }
+            }
+        }
+        // Don't keep track of groups that have no offsets left
+        if (shard.groups[group_id]->offsets.empty()) {
+            shard.remove_group(group_id);
+            auto history_iter = shard.consumer_histories.find(update.group_id);
+            if (history_iter != shard.consumer_histories.end()) {
+                for (const auto& history_pair : history_iter->second) {
+                    release_history(history_pair.second);
+                }
+                shard.consumer_histories.erase(history_iter);
+            }
+            auto state_iter = shard.consumer_states.find(update.group_id);
+            if (state_iter != shard.consumer_states.end() &&
+                state_iter->second == ConsumerGroupState::DEAD) {
+                on_consumer_state_change(shard, update.group_id, ConsumerGroupState::UNKNOWN);
+                shard.consumer_states.erase(state_iter);
+            }
+        }
+        return false;
+    }
+    bool is_new_consumer = false;
+    GroupId group_id;
+    if (iter == shard.group_ids->end()) {
+        group_id = shard.groups.size();
+        shard.group_ids.get_mutable(shard.generation).emplace(update.group_id, group_id);
+        ConsumerGroup new_group;
+        new_group.group_id = update.group_id;
+        auto state_iter = shard.consumer_states.find(update.group_id);
+        new_group.is_active = state_iter == shard.consumer_states.end() ||
+                              is_active_state(state_iter->second);
+        shard.groups.emplace_back(move(new_group), shard.generation);
+        is_new_consumer = true;
+    }
+    else {
+        group_id = iter->second;
+    }
+    // Only this group is copied if the published view has it
+    ConsumerGroup& group = shard.get_mutable_group(group_id);
+    // Commits without a timestamp count as happening now
+    group.commit_timestamp = max(group.commit_timestamp,
+                                 update.timestamp > 0 ? update.timestamp : get_current_timestamp());
+    if (update.offsets_partition != -1) {
+        group.offsets_partition = update.offsets_partition;
+    }
+    const PartitionOffset entry{ shard.get_topic_id(update.topic, topic_names_),
+                                 update.partition, update.offset, version };
+    // Log the group the first time it changes on this generation
+    if (group.version <= shard.view_version) {
+        shard.pending_changed_groups.emplace_back(group_id);
+    }
+    group.version = version;
+    auto offset_iter = lower_bound(group.offsets.begin(), group.offsets.end(), entry);
+    if (offset_iter != group.offsets.end() && !(entry < *offset_iter)) {
+        offset_iter->offset = update.offset;
+        offset_iter->version = version;
+    }
+    else {
+        group.offsets.insert(offset_iter, entry);
+        shard.add_topic_reference(entry.topic_id);
+        add_topic_consumer(update.topic, update.group_id);
+    }
+    if (history_size_ > 0 && update.timestamp > 0) {
+        PartitionHistoryMap& histories = shard.consumer_histories[update.group_id];
+        auto history_iter = histories.find({ entry.topic_id, entry.partition });
+        if (history_iter == histories.end()) {
+            OffsetHistory history(history_size_);
+            if (reserve_history(history)) {
+                history_iter = histories.emplace(make_pair(entry.topic_id, entry.partition),
+                                                 move(history)).first;
+            }
+        }
+        if (history_iter != histories.end()) {
+            history_iter->second.add_sample(update.timestamp, update.offset);
+        }
+    }
+    return is_new_consumer;
+}
+
+void OffsetStore::remove_consumer_offsets(ConsumerShard& shard, const string& group_id,
+                                          const string* topic) {
+    const ConsumerGroup* group = shard.find_group(group_id);
+    if (!group) {
+        return;
+    }
+    // Collect them first as offsets are removed from the group. Names are copied as removing
+    // offsets can free them
+    vector<pair<string, int32_t>> partitions;
+    for (const PartitionOffset& entry : group->offsets) {
+        const string& topic_name = shard.get_topic_name(entry.topic_id);
+        if (!topic || topic_name == *topic) {
+            partitions.emplace_back(topic_name, entry.partition);
+        }
+    }
+    for (const auto& partition_pair : partitions) {
+        apply_update(shard, { group_id, partition_pair.first, partition_pair.second, 0, true,
+                              -1, 0 }, ++version_);
+    }
+}
+
+void OffsetStore::add_topic_consumer(const string& topic, const string& group_id) {
+    TopicShard& shard = get_topic_shard(topic);
+    lock_guard<mutex> _(shard.mutex);
+    auto iter = shard.topic_consumers.find(topic);
+    if (iter == shard.topic_consumers.end()) {
+        iter = shard.topic_consumers.emplace(
+            topic, CopyOnWrite<ConsumerCountMap>(ConsumerCountMap(), shard.generation)
+        ).first;
+    }
+    iter->second.get_mutable(shard.generation)[group_id]++;
+    shard.dirty = true;
+}
+
+void OffsetStore::remove_topic_consumer(const string& topic, const string& group_id) {
+    TopicShard& shard = get_topic_shard(topic);
+    lock_guard<mutex> _(shard.mutex);
+    auto topic_iter = shard.topic_consumers.find(topic);
+    if (topic_iter == shard.topic_consumers.end()) {
+        return;
+    }
+    ConsumerCountMap& consumers = topic_iter->second.get_mutable(shard.generation);
+    auto consumer_iter = consumers.find(group_id);
+    if (consumer_iter != consumers.end() && --consumer_iter->second == 0) {
+        consumers.erase(consumer_iter);
+        if (consumers.empty()) {
+            shard.topic_consumers.erase(topic_iter);
+        }
+    }
+    shard.dirty = true;
+}
+
+template <typename Functor>
+void OffsetStore::visit_topic_consumer_offsets(const string& topic,
+                                               const Functor& callback) const {
+    const auto topic_view = get_view(get_topic_shard(topic));
+    auto iter = topic_view->topic_consumers.find(topic);
+    if (iter == topic_view->topic_consumers.end()) {
+        return;
+    }
+    for (const auto& consumer_pair : *iter->second) {
+        // Views are published independently so the group may be gone from its own
+        const auto view = get_view(get_consumer_shard(consumer_pair.first));
+        const ConsumerGroup* group = view->find_group(consumer_pair.first);
+        const TopicId* topic_id = view->find_topic_id(topic);
+        if (!group || !topic_id) {
+            continue;
+        }
+        // Offsets are sorted by topic id so this topic's ones are contiguous
+        const PartitionOffset first{ *topic_id, numeric_limits<int32_t>::min(), 0, 0 };
+        auto offset_iter = lower_bound(group->offsets.begin(), group->offsets.end(), first);
+        for (; offset_iter != group->offsets.end() && offset_iter->topic_id == *topic_id;
+             ++offset_iter) {
+            callback(*group, *offset_iter);
+        }
+    }
+}
+
+optional<int64_t> OffsetStore::find_message_timestamp(const TopicShard& shard,
+                                                      const string& topic, int partition,
+                                                      int64_t offset) const {
+    auto topic_iter = shard.message_timestamps.find(topic);
+    if (topic_iter == shard.message_timestamps.end()) {
+        return boost::none;
+    }
+    auto partition_iter = topic_iter->second.find(partition);
+    if (partition_iter == topic_iter->second.end()) {
+        return boost::none;
+    }
+    auto bucket_iter = partition_iter->second.find(offset / timestamp_bucket_size_);
+    if (bucket_iter == partition_iter->second.end()) {
+        return boost::none;
+    }
+    return bucket_iter->second;
+}
+
+size_t OffsetStore::get_consumer_size(const ConsumerGroup& group) {
+    // The group id is also a key in the shard's group ids
+    return sizeof(ConsumerGroup) + 2 * memory::get_heap_size(group.group_id) +
+           memory::get_heap_size(group.offsets);
+}
+
+size_t OffsetStore::get_topic_size(const TopicShard& shard, const string& topic) {
+    using memory::get_heap_size;
+
+    size_t output = 0;
+    auto offsets_iter = shard.topic_offsets.find(topic);
+    if (offsets_iter != shard.topic_offsets.end()) {
+        output += sizeof(*offsets_iter) + sizeof(TopicOffsets) + get_heap_size(topic) +
+                  get_heap_size(offsets_iter->second->offsets) +
+                  get_heap_size(offsets_iter->second->versions);
+    }
+    auto consumers_iter = shard.topic_consumers.find(topic);
+    if (consumers_iter != shard.topic_consumers.end()) {
+        output += get_heap_size(*consumers_iter->second);
+        for (const auto& consumer_pair : *consumers_iter->second) {
+            output += get_heap_size(consumer_pair.first);
+        }
+    }
+    auto history_iter = shard.topic_histories.find(topic);
+    if (history_iter != shard.topic_histories.end()) {
+        output += get_heap_size(history_iter->second);
+        for (const auto& history_pair : history_iter->second) {
+            output += history_pair.second.get_size();
+        }
+    }
+    auto timestamps_iter = shard.message_timestamps.find(topic);
+    if (timestamps_iter != shard.message_timestamps.end()) {
+        output += get_heap_size(timestamps_iter->second);
+        for (const auto& partition_pair : timestamps_iter->second) {
+            output += get_heap_size(partition_pair.second);
+        }
+    }
+    return output;
+}
+
+void OffsetStore::add_memory_usage(const ConsumerShardData& data, vector<MemoryUsage>& output) {
+    using memory::get_heap_size;
+
+    size_t offset_count = 0;
+    size_t offset_bytes = 0;
+    size_t group_bytes = get_heap_size(data.groups) + get_heap_size(*data.group_ids);
+    for (const auto& group : data.groups) {
+        offset_count += group->offsets.size();
+        offset_bytes += get_heap_size(group->offsets);
+        group_bytes += sizeof(ConsumerGroup) + 2 * get_heap_size(group->group_id);
+    }
+    // The names themselves are accounted for once, by the interner
+    const size_t topic_bytes = get_heap_size(*data.topic_names) +
+                               get_heap_size(*data.topic_ids);
+    size_t removal_bytes = get_heap_size(*data.removed_offsets);
+    for (const RemovedOffset& removal : *data.removed_offsets) {
+        removal_bytes += get_heap_size(removal.group_id);
+    }
+    add_usage(output, "consumer groups", data.groups.size(), group_bytes);
+    add_usage(output, "consumer offsets", offset_count, offset_bytes);
+    add_usage(output, "consumer topic names", data.topic_names->size(), topic_bytes);
+    add_usage(output, "removed consumer offsets", data.removed_offsets->size(), removal_bytes);
+    size_t change_count = 0;
+    size_t change_bytes = get_heap_size(*data.changed_groups);
+    for (const ChangeBatch<GroupId>& batch : *data.changed_groups) {
+        change_count += batch.ids->size();
+        change_bytes += sizeof(vector<GroupId>) + get_heap_size(*batch.ids);
+    }
+    add_usage(output, "changed consumer groups", change_count, change_bytes);
+}
+
+void OffsetStore::add_memory_usage(const TopicShardData& data, vector<MemoryUsage>& output) {
+    using memory::get_heap_size;
+
+    size_t partition_count = 0;
+    size_t offset_bytes = get_heap_size(data.topic_offsets);
+    for (const auto& topic_pair : data.topic_offsets) {
+        partition_count += topic_pair.second->offsets.size();
+        offset_bytes += sizeof(TopicOffsets) + get_heap_size(topic_pair.first) +
+                        get_heap_size(topic_pair.second->offsets) +
+                        get_heap_size(topic_pair.second->versions);
+    }
+    size_t consumer_count = 0;
+    size_t consumer_bytes = get_heap_size(data.topic_consumers);
+    for (const auto& topic_pair : data.topic_consumers) {
+        consumer_count += topic_pair.second->size();
+        consumer_bytes += sizeof(ConsumerCountMap) + get_heap_size(topic_pair.first) +
+                          get_heap_size(*topic_pair.second);
+        for (const auto& consumer_pair : *topic_pair.second) {
+            consumer_bytes += get_heap_size(consumer_pair.first);
+        }
+    }
+    size_t removal_bytes = get_heap_size(*data.removed_topics);
+    for (const RemovedTopic& removal : *data.removed_topics) {
+        removal_bytes += get_heap_size(removal.topic);
+    }
+    add_usage(output, "topic offsets", partition_count, offset_bytes);
+    add_usage(output, "topic consumers", consumer_count, consumer_bytes);
+    add_usage(output, "removed topics", data.removed_topics->size(), removal_bytes);
+    size_t change_count = 0;
+    size_t change_bytes = get_heap_size(*data.changed_topics);
+    for (const ChangeBatch<string>& batch : *data.changed_topics) {
+        change_count += batch.ids->size();
+        change_bytes += sizeof(vector<string>) + get_heap_size(*batch.ids);
+        for (const string& topic : *batch.ids) {
+            change_bytes += get_heap_size(topic);
+        }
+    }
+    add_usage(output, "changed topics", change_count, change_bytes);
+}
+
+template <typename Functor>
+void OffsetStore::visit_shard_lags(const Functor& callback) const {
+    vector<shared_ptr<const TopicShardData>> topic_views;
+    for (const TopicShard& shard : topic_shards_) {
+        topic_views.emplace_back(get_view(shard));
+    }
+    const bool ignore_inactive = ignore_inactive_consumers_;
+    // Reused across shards so they don't allocate once they're large enough
+    ShardLags lags;
+    vector<const vector<int64_t>*> watermarks;
+    for (const ConsumerShard& shard : consumer_shards_) {
+        const auto view = get_view(shard);
+        // Look up each of the shard's topics once rather than once per offset
+        const auto& topic_names = *view->topic_names;
+        watermarks.assign(topic_names.size(), nullptr);
+        for (size_t i = 0; i < topic_names.size(); ++i) {
+            if (!topic_names[i]) {
+                continue;
+            }
+            const string& topic = *topic_names[i];
+            const TopicShardData& topic_view = *topic_views[&get_topic_shard(topic) -
+                                                            topic_shards_.data()];
+            auto iter = topic_view.topic_offsets.find(topic);
+            if (iter != topic_view.topic_offsets.end()) {
+                watermarks[i] = &iter->second->offsets;
+            }
+        }
+        lags.clear();
+        for (GroupId group_id = 0; group_id < view->groups.size(); ++group_id) {
+            const ConsumerGroup& group = *view->groups[group_id];
+            if (ignore_inactive && !group.is_active) {
+                continue;
+            }
+            for (const PartitionOffset& entry : group.offsets) {
+                const vector<int64_t>* offsets = watermarks[entry.topic_id];
+                if (!offsets || entry.partition < 0 ||
+                    static_cast<size_t>(entry.partition) >= offsets->size() ||
+                    (*offsets)[entry.partition] == NO_OFFSET) {
+                    continue;
+                }
+                lags.group_indexes.emplace_back(group_id);
+                lags.topic_ids.emplace_back(entry.topic_id);
+                lags.partitions.emplace_back(entry.partition);
+                lags.consumer_offsets.emplace_back(entry.offset);
+                lags.topic_offsets.emplace_back((*offsets)[entry.partition]);
+            }
+        }
+        // Keep this loop branch free over plain arrays so the compiler can vectorize it
+        const size_t count = lags.consumer_offsets.size();
+        lags.lags.resize(count);
+        const int64_t* consumer_offsets = lags.consumer_offsets.data();
+        const int64_t* topic_offsets = lags.topic_offsets.data();
+        int64_t* output = lags.lags.data();
+        for (size_t i = 0; i < count; ++i) {
+            const int64_t lag = topic_offsets[i] - consumer_offsets[i];
+            output[i] = lag > 0 ? lag : 0;
+        }
+        callback(view, lags);
+    }
+}
+
+void OffsetStore::reset_lag_rollups() {
+    lag_rollups_.clear();
+    for (ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        shard.changed_states.clear();
+        for (const auto& state_pair : shard.consumer_states) {
+            if (!is_active_state(state_pair.second)) {
+                lag_rollups_.set_group_active(state_pair.first, false);
+            }
+        }
+    }
+}
+
+void OffsetStore::update_lag_rollups() {
+    lock_guard<mutex> _(lag_rollups_mutex_);
+    if (!lag_rollups_enabled_) {
+        return;
+    }
+    const ChangeSet changes = changes_since(lag_rollups_version_);
+    if (changes.reset) {
+        reset_lag_rollups();
+    }
+    // States go first so new groups start out in the right one
+    for (ConsumerShard& shard : consumer_shards_) {
+        lock_guard<mutex> _(shard.mutex);
+        for (const string& group_id : shard.changed_states) {
+            auto iter = shard.consumer_states.find(group_id);
+            lag_rollups_.set_group_active(group_id, iter == shard.consumer_states.end() ||
+                                                    is_active_state(iter->second));
+        }
+        shard.changed_states.clear();
+    }
+    // Removals first, anything stored afterwards is in the stored offsets too
+    for (const string& topic : changes.removed_topics) {
+        lag_rollups_.remove_topic(topic);
+    }
+    for (const ConsumerOffset& offset : changes.removed_consumer_offsets) {
+        const TopicPartition& topic_partition = offset.get_topic_partition();
+        lag_rollups_.remove_consumer_offset(offset.get_group_id(), topic_partition.get_topic(),
+                                            topic_partition.get_partition());
+    }
+    for (const TopicPartition& topic_partition : changes.topic_offsets) {
+        lag_rollups_.store_topic_offset(topic_partition.get_topic(),
+                                        topic_partition.get_partition(),
+                                        topic_partition.get_offset());
+    }
+    for (const ConsumerOffset& offset : changes.consumer_offsets) {
+        const TopicPartition& topic_partition = offset.get_topic_partition();
+        lag_rollups_.store_consumer_offset(offset.get_group_id(), topic_partition.get_topic(),
+                                           topic_partition.get_partition(),
+                                           topic_partition.get_offset());
+    }
+    lag_rollups_version_ = changes.version;
+}
+
+void OffsetStore::publish_shard(ConsumerShard& shard) {
+    // Changes to this shard only happen while holding its lock, so everything up to the
+    // current version is there
+    const Version version = version_;
+    if (shard.dirty) {
+        log_changes(shard.changed_groups, shard.change_horizon, shard.pending_changed_groups,
+                    version, shard.generation);
+        // This only copies the tables, whatever changes next is copied when it's changed
+        const ConsumerShardData& data = shard;
+        atomic_store(&shard.view, make_shared<const ConsumerShardData>(data));
+        shard.generation++;
+        shard.dirty = false;
+    }
+    shard.view_version = version;
+}
+
+void OffsetStore::publish_shard(TopicShard& shard) {
+    const Version version = version_;
+    if (shard.dirty) {
+        log_changes(shard.changed_topics, shard.change_horizon, shard.pending_changed_topics,
+                    version, shard.generation);
+        const TopicShardData& data = shard;
+        atomic_store(&shard.view, make_shared<const TopicShardData>(data));
+        shard.generation++;
+        shard.dirty = false;
+    }
+    shard.view_version = version;
+}
+
+template <typename T>
+void OffsetStore::log_changes(ChangeLog<T>& log, Version& horizon, vector<T>& pending,
+                              Version version, Generation generation) {
+    if (pending.empty()) {
+        return;
+    }
+    // Moved groups can show up twice
+    sort(pending.begin(), pending.end());
+    pending.erase(unique(pending.begin(), pending.end()), pending.end());
+    auto& batches = log.get_mutable(generation);
+    batches.push_back({ version, make_shared<const vector<T>>(move(pending)) });
+    pending.clear();
+    size_t id_count = 0;
+    for (const ChangeBatch<T>& batch : batches) {
+        id_count += batch.ids->size();
+    }
+    while (!batches.empty() &&
+           (batches.size() > MAXIMUM_CHANGE_BATCHES || id_count > MAXIMUM_CHANGED_IDS)) {
+        horizon = batches.front().version;
+        id_count -= batches.front().ids->size();
+        batches.pop_front();
+    }
+}
+
+shared_ptr<const OffsetStore::ConsumerShardData>
+OffsetStore::get_view(const ConsumerShard& shard) {
+    // Readers keep whatever version they loaded alive until they're done with it
+    return atomic_load(&shard.view);
+}
+
+shared_ptr<const OffsetStore::TopicShardData> OffsetStore::get_view(const TopicShard& shard) {
+    return atomic_load(&shard.view);
+}
+
+bool OffsetStore::is_active_state(ConsumerGroupState state) {
+    return state != ConsumerGroupState::EMPTY && state != ConsumerGroupState::DEAD;
+}
+
+void OffsetStore::on_consumer_state_change(ConsumerShard& shard, const string& group_id,
+                                           ConsumerGroupState new_state) {
+    auto iter = shard.consumer_states.find(group_id);
+    const ConsumerGroupState old_state = iter != shard.consumer_states.end() ?
+                                         iter->second : ConsumerGroupState::UNKNOWN;
+    const bool is_active = is_active_state(new_state);
+    if (is_active_state(old_state) == is_active) {
+        return;
+    }
+    auto group_iter = shard.group_ids->find(group_id);
+    if (group_iter != shard.group_ids->end()) {
+        shard.get_mutable_group(group_iter->second).is_active = is_active;
+        shard.dirty = true;
+    }
+    if (lag_rollups_enabled_) {
+        shard.changed_states.emplace_back(group_id);
+    }
+}
+
+bool OffsetStore::is_consumer_ignored(const ConsumerShard& shard,
+                                      const string& group_id) const {
+    if (!ignore_inactive_consumers_) {
+        return false;
+    }
+    auto iter = shard.consumer_states.find(group_id);
+    return iter != shard.consumer_states.end() && !is_active_state(iter->second);
+}
+
+size_t OffsetStore::get_consumer_shard_index(const string& group_id) const {
+    return hash<string>()(group_id) % consumer_shards_.size();
+}
+
+OffsetStore::ConsumerShard& OffsetStore::get_consumer_shard(const string& group_id) {
+    return consumer_shards_[get_consumer_shard_index(group_id)];
+}
+
+const OffsetStore::ConsumerShard& OffsetStore::get_consumer_shard(const string& group_id) const {
+    return consumer_shards_[get_consumer_shard_index(group_id)];
+}
+
+OffsetStore::TopicShard& OffsetStore::get_topic_shard(const string& topic) {
+    return topic_shards_[hash<string>()(topic) % topic_shards_.size()];
+}
+
+const OffsetStore::TopicShard& OffsetStore::get_topic_shard(const string& topic) const {
+    return topic_shards_[hash<string>()(topic) % topic_shards_.size()];
+}
+
+void OffsetStore::run_publisher() {
+    unique_lock<mutex> lock(publisher_mutex_);
+    while (publisher_running_) {
+        publisher_condition_.wait_for(lock, publish_interval_);
+        if (!publisher_running_) {
+            break;
+        }
+        lock.unlock();
+        publish();
+        lock.lock();
+    }
+}
+
+bool OffsetStore::is_partition_ready(const set<int>& ready_partitions, int partition) const {
+    return consumer_offsets_loaded_ || ready_partitions.count(partition);
+}
+
+bool OffsetStore::is_partition_ready(int partition) const {
+    if (consumer_offsets_loaded_) {
+        return true;
+    }
+    lock_guard<mutex> _(positions_mutex_);
+    return ready_partitions_.count(partition);
+}
+
+bool OffsetStore::reserve_history(const OffsetHistory& history) {
+    const size_t size = history.get_maximum_size();
+    const size_t maximum_size = maximum_history_size_;
+    size_t reserved_size = reserved_history_size_;
+    do {
+        if (maximum_size > 0 && reserved_size + size > maximum_size) {
+            return false;
+        }
+    } while (!reserved_history_size_.compare_exchange_weak(reserved_size, reserved_size + size));
+    history_series_count_++;
+    return true;
+}
+
+void OffsetStore::release_history(const OffsetHistory& history) {
+    reserved_history_size_ -= history.get_maximum_size();
+    history_series_count_--;
+}
+
+void OffsetStore::ShardLags::clear() {
+    group_indexes.clear();
+    topic_ids.clear();
+    partitions.clear();
+    consumer_offsets.clear();
+    topic_offsets.clear();
+    lags.clear();
+}
+
+bool OffsetStore::PartitionOffset::operator<(const PartitionOffset& rhs) const {
+    return tie(topic_id, partition) < tie(rhs.topic_id, rhs.partition);
+}
+
+const OffsetStore::ConsumerGroup*
+OffsetStore::ConsumerShardData::find_group(const string& group_id) const {
+    auto iter = group_ids->find(group_id);
+    return iter != group_ids->end() ? &*groups[iter->second] : nullptr;
+}
+
+const OffsetStore::TopicId*
+OffsetStore::ConsumerShardData::find_topic_id(const string& topic) const {
+    auto iter = topic_ids->find(string_ref(topic));
+    return iter != topic_ids->end() ? &iter->second : nullptr;
+}
+
+const string& OffsetStore::ConsumerShardData::get_topic_name(TopicId id) const {
+    return *(*topic_names)[id];
+}
+
+OffsetStore::ConsumerGroup& OffsetStore::ConsumerShard::get_mutable_group(GroupId id) {
+    return groups[id].get_mutable(generation);
+}
+
+OffsetStore::TopicId OffsetStore::ConsumerShard::get_topic_id(const string& topic,
+                                                           SharedStringInterner& interner) {
+    const TopicId* existing_id = find_topic_id(topic);
+    if (existing_id) {
+        return *existing_id;
+    }
+    auto& names = topic_names.get_mutable(generation);
+    TopicId id;
+    if (!free_topic_ids.empty()) {
+        id = free_topic_ids.back();
+        free_topic_ids.pop_back();
+        names[id] = interner.intern(topic);
+    }
+    else {
+        id = names.size();
+        names.emplace_back(interner.intern(topic));
+        topic_references.emplace_back(0);
+    }
+    topic_ids.get_mutable(generation).emplace(string_ref(*names[id]), id);
+    return id;
+}
+
+void OffsetStore::ConsumerShard::add_topic_reference(TopicId id) {
+    topic_references[id]++;
+}
+
+void OffsetStore::ConsumerShard::remove_topic_reference(TopicId id) {
+    if (--topic_references[id] > 0) {
+        return;
+    }
+    // Views keep their own references to the names, so the id can be reused right away
+    auto& names = topic_names.get_mutable(generation);
+    topic_ids.get_mutable(generation).erase(string_ref(*names[id]));
+    names[id].reset();
+    free_topic_ids.emplace_back(id);
+}
+
+void OffsetStore::ConsumerShard::remove_group(GroupId id) {
+    auto& ids = group_ids.get_mutable(generation);
+    ids.erase(groups[id]->group_id);
+    if (id + 1 != groups.size()) {
+        groups[id] = move(groups.back());
+        ids[groups[id]->group_id] = id;
+        // Change sets can only find the moved group through its new id
+        pending_changed_groups.emplace_back(id);
+    }
+    groups.pop_back();
 }
 
 } // pirulo
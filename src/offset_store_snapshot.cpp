@@ -0,0 +1,290 @@
+#include <vector>
+#include <tuple>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "offset_store_snapshot.h"
+#include "exceptions.h"
+#include "detail/memory.h"
+#include "detail/logging.h"
+#include "utils/string_interner.h"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::pair;
+using std::tuple;
+using std::move;
+
+using boost::string_ref;
+
+using cppkafka::TopicPartition;
+
+namespace pirulo {
+
+PIRULO_CREATE_LOGGER("p.snapshot");
+
+static const uint32_t SNAPSHOT_MAGIC = 0x50524c4f;
+static const uint16_t SNAPSHOT_VERSION = 4;
+
+// Writes partition offsets grouped by topic. Entries must be sorted by topic
+static void write_topic_offsets(OutputMemoryStream& output,
+                                const vector<TopicPartition>& topic_partitions) {
+    uint32_t topic_count = 0;
+    for (size_t i = 0; i < topic_partitions.size(); ++i) {
+        if (i == 0 || topic_partitions[i].get_topic() != topic_partitions[i - 1].get_topic()) {
+            topic_count++;
+        }
+    }
+    output.write_be(topic_count);
+    auto iter = topic_partitions.begin();
+    while (iter != topic_partitions.end()) {
+        const string& topic = iter->get_topic();
+        auto topic_end = iter;
+        while (topic_end != topic_partitions.end() && topic_end->get_topic() == topic) {
+            ++topic_end;
+        }
+        output.write(topic);
+        output.write_be<uint32_t>(topic_end - iter);
+        for (; iter != topic_end; ++iter) {
+            output.write_be<int32_t>(iter->get_partition());
+            output.write_be<int64_t>(iter->get_offset());
+        }
+    }
+}
+
+template <typename Functor>
+static void read_topic_offsets(InputMemoryStream& input, const Functor& callback) {
+    const uint32_t topic_count = input.read_be<uint32_t>();
+    for (uint32_t i = 0; i < topic_count; ++i) {
+        const string_ref topic = input.read<string_ref>();
+        const uint32_t partition_count = input.read_be<uint32_t>();
+        for (uint32_t j = 0; j < partition_count; ++j) {
+            const int partition = input.read_be<int32_t>();
+            const int64_t offset = input.read_be<int64_t>();
+            callback(topic, partition, offset);
+        }
+    }
+}
+
+// Read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(int fd, size_t size)
+    : size_(size) {
+        if (size_ > 0) {
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data_ == MAP_FAILED) {
+                throw Exception("Failed to map snapshot file");
+            }
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_ != MAP_FAILED) {
+            munmap(data_, size_);
+        }
+    }
+
+    const uint8_t* get_data() const {
+        return static_cast<const uint8_t*>(data_);
+    }
+
+    size_t get_size() const {
+        return size_;
+    }
+private:
+    void* data_{MAP_FAILED};
+    size_t size_;
+};
+
+// Writes the whole buffer into a new file and makes sure it reached the disk
+static void write_file(const string& path, const vector<uint8_t>& buffer) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw Exception("Failed to create snapshot file " + path);
+    }
+    size_t written = 0;
+    while (written < buffer.size()) {
+        const ssize_t result = write(fd, buffer.data() + written, buffer.size() - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1) {
+            close(fd);
+            unlink(path.c_str());
+            throw Exception("Failed to write snapshot file " + path);
+        }
+        written += result;
+    }
+    // close can report write errors too
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        unlink(path.c_str());
+        throw Exception("Failed to sync snapshot file " + path);
+    }
+}
+
+static void sync_directory(const string& path) {
+    const size_t separator = path.rfind('/');
+    const string directory = separator == string::npos ? "." :
+                             separator == 0 ? "/" : path.substr(0, separator);
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        throw Exception("Failed to open snapshot directory " + directory);
+    }
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+    if (!synced) {
+        throw Exception("Failed to sync snapshot directory " + directory);
+    }
+}
+
+OffsetStoreSnapshot::OffsetStoreSnapshot(string path)
+: path_(move(path)) {
+
+}
+
+void OffsetStoreSnapshot::save(OffsetStore& store) const {
+    vector<uint8_t> buffer;
+    OutputMemoryStream output(buffer);
+    output.write_be(SNAPSHOT_MAGIC);
+    output.write_be(SNAPSHOT_VERSION);
+
+    // Positions go first: anything published afterwards is at least as recent as them, and
+    // replaying records on top of newer ones is harmless
+    const map<int, int64_t> positions = store.get_consumer_offsets_positions();
+    store.publish();
+    output.write_be<uint32_t>(positions.size());
+    for (const auto& position_pair : positions) {
+        output.write_be<int32_t>(position_pair.first);
+        output.write_be<int64_t>(position_pair.second);
+    }
+
+    write_topic_offsets(output, store.get_topic_offsets());
+
+    const vector<string> consumers = store.get_consumers();
+    output.write_be<uint32_t>(consumers.size());
+    for (const string& group_id : consumers) {
+        vector<TopicPartition> topic_partitions;
+        for (const ConsumerOffset& offset : store.get_consumer_offsets(group_id)) {
+            topic_partitions.emplace_back(offset.get_topic_partition());
+        }
+        output.write(group_id);
+        output.write_be<int32_t>(store.get_consumer_offsets_partition(group_id).value_or(-1));
+        // Keeps groups' eviction deadlines across restarts
+        output.write_be<int64_t>(store.get_consumer_commit_timestamp(group_id));
+        write_topic_offsets(output, topic_partitions);
+    }
+
+    const map<string, OffsetStore::ConsumerGroupState> states = store.get_consumer_states();
+    output.write_be<uint32_t>(states.size());
+    for (const auto& state_pair : states) {
+        output.write(state_pair.first);
+        output.write<uint8_t>(static_cast<uint8_t>(state_pair.second));
+    }
+
+    const string temporary_path = path_ + ".tmp";
+    write_file(temporary_path, buffer);
+    if (rename(temporary_path.c_str(), path_.c_str()) != 0) {
+        unlink(temporary_path.c_str());
+        throw Exception("Failed to rename snapshot file to " + path_);
+    }
+    // The rename itself only survives a crash once the directory is synced
+    sync_directory(path_);
+    LOG4CXX_DEBUG(logger, "Saved " << buffer.size() << " bytes snapshot into " << path_);
+}
+
+bool OffsetStoreSnapshot::load(OffsetStore& store) const {
+    const int fd = open(path_.c_str(), O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        throw Exception("Failed to open snapshot file " + path_);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw Exception("Failed to stat snapshot file " + path_);
+    }
+    const MappedFile file(fd, file_stat.st_size);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    // Parse everything before touching the store so a broken file doesn't leave it half
+    // loaded. Strings are either views into the mapping or interned
+    InputMemoryStream input(file.get_data(), file.get_size());
+    if (input.read_be<uint32_t>() != SNAPSHOT_MAGIC) {
+        throw Exception("File " + path_ + " is not a snapshot");
+    }
+    if (input.read_be<uint16_t>() != SNAPSHOT_VERSION) {
+        throw Exception("Unsupported snapshot version on " + path_);
+    }
+
+    const uint32_t position_count = input.read_be<uint32_t>();
+    if (!input.can_read(position_count * (sizeof(int32_t) + sizeof(int64_t)))) {
+        throw ParseException();
+    }
+    vector<pair<int, int64_t>> positions(position_count);
+    for (auto& position_pair : positions) {
+        position_pair.first = input.read_be<int32_t>();
+        position_pair.second = input.read_be<int64_t>();
+    }
+
+    vector<tuple<string_ref, int, int64_t>> topic_offsets;
+    read_topic_offsets(input, [&](string_ref topic, int partition, int64_t offset) {
+        topic_offsets.emplace_back(topic, partition, offset);
+    });
+
+    StringInterner interned_strings;
+    vector<OffsetStore::ConsumerOffsetUpdate> updates;
+    const uint32_t consumer_count = input.read_be<uint32_t>();
+    for (uint32_t i = 0; i < consumer_count; ++i) {
+        const string& group_id = interned_strings.intern(input.read<string_ref>());
+        const int offsets_partition = input.read_be<int32_t>();
+        const int64_t commit_timestamp = input.read_be<int64_t>();
+        read_topic_offsets(input, [&](string_ref topic, int partition, int64_t offset) {
+            updates.push_back({ group_id, interned_strings.intern(topic), partition, offset,
+                                false, offsets_partition, commit_timestamp });
+        });
+    }
+
+    vector<pair<string_ref, OffsetStore::ConsumerGroupState>> states;
+    const uint32_t state_count = input.read_be<uint32_t>();
+    for (uint32_t i = 0; i < state_count; ++i) {
+        const string_ref group_id = input.read<string_ref>();
+        const uint8_t state = input.read<uint8_t>();
+        if (state > static_cast<uint8_t>(OffsetStore::ConsumerGroupState::DEAD)) {
+            throw ParseException();
+        }
+        states.emplace_back(group_id, static_cast<OffsetStore::ConsumerGroupState>(state));
+    }
+
+    for (const auto& position_pair : positions) {
+        store.set_consumer_offsets_position(position_pair.first, position_pair.second);
+    }
+    for (const auto& topic_offset : topic_offsets) {
+        store.store_topic_offset(std::get<0>(topic_offset).to_string(),
+                                 std::get<1>(topic_offset), std::get<2>(topic_offset));
+    }
+    store.store_consumer_offsets(updates);
+    for (const auto& state_pair : states) {
+        store.store_consumer_group_state(state_pair.first.to_string(), state_pair.second);
+    }
+    store.publish();
+    LOG4CXX_INFO(logger, "Loaded snapshot with " << consumer_count << " consumers and "
+                 << topic_offsets.size() << " topic/partitions from " << path_);
+    return true;
+}
+
+const string& OffsetStoreSnapshot::get_path() const {
+    return path_;
+}
+
+} // pirulo
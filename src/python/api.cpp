@@ -19,8 +19,12 @@ using std::bind;
 using std::ref;
 using std::shared_ptr;
 
+using std::chrono::milliseconds;
+
 using boost::optional;
 
+using cppkafka::TopicPartition;
+
 namespace python = boost::python;
 
 namespace pirulo {
@@ -89,6 +93,12 @@ private:
         exec_method(self_, "handle_lag_update", topic, partition, group_id, consumer_lag);
     }
 
+    void handle_time_lag_update(const string& topic, int partition,
+                                const string& group_id, milliseconds time_lag) {
+        const int64_t time_lag_ms = time_lag.count();
+        exec_method(self_, "handle_time_lag_update", topic, partition, group_id, time_lag_ms);
+    }
+
     python::object self_;
 };
 
@@ -141,6 +151,7 @@ void register_types() {
      using python::call;
 
     to_python_converter<optional<int64_t>, value_or_none<int64_t>>();
+    to_python_converter<optional<LagRollups::Rollup>, value_or_none<LagRollups::Rollup>>();
 
     class_<ConsumerOffset>("ConsumerOffset", no_init)
         .add_property("group_id",
@@ -157,11 +168,102 @@ void register_types() {
         })
         ;
 
+    class_<TopicPartition>("TopicPartition", no_init)
+        .add_property("topic", make_function(&TopicPartition::get_topic,
+                                             return_internal_reference<>()))
+        .add_property("partition", &TopicPartition::get_partition)
+        .add_property("offset", &TopicPartition::get_offset)
+        ;
+
+    class_<OffsetHistory::Sample>("OffsetSample", no_init)
+        .def_readonly("timestamp", &OffsetHistory::Sample::timestamp)
+        .def_readonly("offset", &OffsetHistory::Sample::offset)
+        ;
+
+    class_<MemoryUsage>("MemoryUsage", no_init)
+        .def_readonly("name", &MemoryUsage::name)
+        .def_readonly("entries", &MemoryUsage::entries)
+        .def_readonly("bytes", &MemoryUsage::bytes)
+        ;
+
+    class_<LagRollups::Rollup>("LagRollup", no_init)
+        .def_readonly("total_lag", &LagRollups::Rollup::total_lag)
+        .def_readonly("offset_count", &LagRollups::Rollup::offset_count)
+        ;
+
+    class_<LagRollups::PartitionLag>("PartitionLag", no_init)
+        .def_readonly("group_id", &LagRollups::PartitionLag::group_id)
+        .def_readonly("topic", &LagRollups::PartitionLag::topic)
+        .def_readonly("partition", &LagRollups::PartitionLag::partition)
+        .def_readonly("lag", &LagRollups::PartitionLag::lag)
+        ;
+
+    class_<LagRollups::GroupLag>("GroupLag", no_init)
+        .def_readonly("group_id", &LagRollups::GroupLag::group_id)
+        .def_readonly("total_lag", &LagRollups::GroupLag::total_lag)
+        .def_readonly("offset_count", &LagRollups::GroupLag::offset_count)
+        ;
+
+    class_<OffsetStore::ChangeSet>("ChangeSet", no_init)
+        .def_readonly("version", &OffsetStore::ChangeSet::version)
+        .def_readonly("reset", &OffsetStore::ChangeSet::reset)
+        .def_readonly("consumer_offsets", &OffsetStore::ChangeSet::consumer_offsets)
+        .def_readonly("removed_consumer_offsets",
+                      &OffsetStore::ChangeSet::removed_consumer_offsets)
+        .def_readonly("topic_offsets", &OffsetStore::ChangeSet::topic_offsets)
+        .def_readonly("removed_topics", &OffsetStore::ChangeSet::removed_topics)
+        ;
+
     class_<OffsetStore, shared_ptr<OffsetStore>, boost::noncopyable>("OffsetStore", no_init)
         .def("get_consumers", &OffsetStore::get_consumers)
         .def("get_consumer_offsets", &OffsetStore::get_consumer_offsets)
         .def("get_topic_offset", &OffsetStore::get_topic_offset)
         .def("get_topics", &OffsetStore::get_topics)
+        .def("is_consumer_ready", &OffsetStore::is_consumer_ready)
+        .def("is_consumer_offsets_loaded", &OffsetStore::is_consumer_offsets_loaded)
+        .def("get_topic_consumers", &OffsetStore::get_topic_consumers)
+        .def("get_topic_consumer_offsets", +[](const OffsetStore& store, const string& topic) {
+            return store.get_topic_consumer_offsets(topic);
+        })
+        .def("get_topic_consumer_offsets", +[](const OffsetStore& store, const string& topic,
+                                               int partition) {
+            return store.get_topic_consumer_offsets(topic, partition);
+        })
+        .def("get_ready_topic_consumer_offsets",
+             &OffsetStore::get_ready_topic_consumer_offsets)
+        .def("changes_since", &OffsetStore::changes_since)
+        .def("get_topic_offset_history", &OffsetStore::get_topic_offset_history)
+        .def("get_consumer_offset_history", &OffsetStore::get_consumer_offset_history)
+        .def("get_memory_usage", &OffsetStore::get_memory_usage)
+        .def("get_largest_consumers", &OffsetStore::get_largest_consumers)
+        .def("get_largest_topics", &OffsetStore::get_largest_topics)
+        // Time lags are returned in milliseconds
+        .def("get_time_lag", +[](const OffsetStore& store, const string& topic, int partition,
+                                 int64_t offset) {
+            const optional<milliseconds> time_lag = store.get_time_lag(topic, partition, offset);
+            return time_lag ? optional<int64_t>(time_lag->count()) : boost::none;
+        })
+        .def("get_consumer_time_lag", +[](const OffsetStore& store, const string& group_id,
+                                          const string& topic, int partition) {
+            const optional<milliseconds> time_lag = store.get_consumer_time_lag(group_id, topic,
+                                                                                partition);
+            return time_lag ? optional<int64_t>(time_lag->count()) : boost::none;
+        })
+        .def("get_consumer_lag", +[](const OffsetStore& store, const string& group_id) {
+            return store.get_consumer_lag(group_id);
+        })
+        .def("get_consumer_lag", +[](const OffsetStore& store, const string& group_id,
+                                     const string& topic) {
+            return store.get_consumer_lag(group_id, topic);
+        })
+        .def("get_consumer_max_lag", &OffsetStore::get_consumer_max_lag)
+        .def("get_topic_lag", &OffsetStore::get_topic_lag)
+        .def("get_largest_partition_lags", &OffsetStore::get_largest_partition_lags)
+        .def("get_largest_consumer_lags", &OffsetStore::get_largest_consumer_lags)
+        .def("is_consumer_active", &OffsetStore::is_consumer_active)
+        .def("is_consumer_ignored", +[](const OffsetStore& store, const string& group_id) {
+            return store.is_consumer_ignored(group_id);
+        })
         .def("on_new_consumer", +[](OffsetStore& store, const object& callback) {
             store.on_new_consumer([=](const string& group_id) {
                 helpers::safe_exec(logger, [&]() {
@@ -203,6 +305,26 @@ void register_types() {
     class_<vector<ConsumerOffset>>("ConsumerOffsetVector")
         .def(vector_indexing_suite<vector<ConsumerOffset>>())
         ;
+
+    class_<vector<TopicPartition>>("TopicPartitionVector")
+        .def(vector_indexing_suite<vector<TopicPartition>>())
+        ;
+
+    class_<vector<MemoryUsage>>("MemoryUsageVector")
+        .def(vector_indexing_suite<vector<MemoryUsage>>())
+        ;
+
+    class_<vector<LagRollups::PartitionLag>>("PartitionLagVector")
+        .def(vector_indexing_suite<vector<LagRollups::PartitionLag>>())
+        ;
+
+    class_<vector<LagRollups::GroupLag>>("GroupLagVector")
+        .def(vector_indexing_suite<vector<LagRollups::GroupLag>>())
+        ;
+
+    class_<OffsetStore::OffsetSamples>("OffsetSampleVector")
+        .def(vector_indexing_suite<OffsetStore::OffsetSamples>())
+        ;
 }
 
 } // api
@@ -21,8 +21,11 @@ void Handler::initialize(const shared_ptr<OffsetStore>& store) {
 
 void Handler::subscribe_to_consumers() {
     offset_store_->on_new_consumer(bind(&Handler::on_new_consumer, this, _1));
+    // Groups that aren't ready yet will be notified once they are
     for (const string& group_id : offset_store_->get_consumers()) {
-        on_new_consumer(group_id);
+        if (offset_store_->is_consumer_ready(group_id)) {
+            on_new_consumer(group_id);
+        }
     }
 }
 
@@ -113,7 +116,8 @@ void Handler::on_topic_message(const string& topic, int partition, int64_t offse
 void Handler::consumer_subscribe(const string& group_id) {
     offset_store_->on_consumer_commit(group_id,
                                       bind(&Handler::on_consumer_commit, this, _1, _2,
-                                           _3, _4));
+                                           _3, _4),
+                                      this);
 }
 
 void Handler::topic_subscribe(const string& topic) {
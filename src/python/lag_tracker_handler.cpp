@@ -5,9 +5,10 @@
 using std::string;
 using std::vector;
 using std::max;
-using std::make_tuple;
 using std::shared_ptr;
 
+using std::chrono::milliseconds;
+
 using boost::optional;
 
 namespace pirulo {
@@ -17,25 +18,7 @@ PIRULO_CREATE_LOGGER("p.lag_tracker");
 
 void LagTrackerHandler::handle_initialize() {
     LOG4CXX_INFO(logger, "Initializing lag tracker handler");
-    const auto& offset_store = get_offset_store();
-    for (const string& consumer : offset_store->get_consumers()) {
-        const vector<ConsumerOffset> offsets = offset_store->get_consumer_offsets(consumer);
-        for (const ConsumerOffset& offset : offsets) {
-            const auto& topic_partition = offset.get_topic_partition();
-            const string& topic = topic_partition.get_topic();
-            const int partition = topic_partition.get_partition();
-            TopicPartitionInfo& info = topic_partition_info_[make_tuple(topic, partition)];
-            info.consumer_offsets.emplace(consumer, topic_partition.get_offset());
-            if (info.offset == -1) {
-                const optional<int64_t> maybe_offset = offset_store->get_topic_offset(topic,
-                                                                                      partition);
-                if (maybe_offset) {
-                    info.offset = *maybe_offset;
-                }
-            }
-        }
-    }
-
+    // Offsets are looked up in the store whenever they're needed, so there's nothing to load
     subscribe_to_topics();
     subscribe_to_topic_message();
     subscribe_to_consumers();
@@ -52,24 +35,40 @@ void LagTrackerHandler::handle_new_topic(const string& topic) {
 
 void LagTrackerHandler::handle_consumer_commit(const string& group_id, const string& topic,
                                                int partition, int64_t offset) {
-    auto& info = topic_partition_info_[make_tuple(topic, partition)];
-    info.consumer_offsets[group_id] = offset;
-    if (info.offset != -1) {
-        handle_lag_update(topic, partition, group_id, max<int64_t>(0, info.offset - offset));
+    const auto& offset_store = get_offset_store();
+    if (!offset_store->is_consumer_ignored(group_id)) {
+        const optional<int64_t> topic_offset = offset_store->get_topic_offset(topic, partition);
+        if (topic_offset) {
+            update_lag(topic, partition, group_id, offset, *topic_offset);
+        }
     }
     Handler::handle_consumer_commit(group_id, topic, partition, offset);
 }
 
 void LagTrackerHandler::handle_topic_message(const string& topic, int partition, int64_t offset) {
-    auto& info = topic_partition_info_[make_tuple(topic, partition)];
-    info.offset = offset;
-    for (const auto& consumer_offset_pair : info.consumer_offsets) {
-        const string& group_id = consumer_offset_pair.first;
-        const uint64_t lag = max<int64_t>(0, offset - consumer_offset_pair.second);
-        handle_lag_update(topic, partition, group_id, lag);
+    const auto& offset_store = get_offset_store();
+    // Only the groups consuming this topic are looked at. Groups that aren't ready are
+    // handled once they're notified as new consumers, and groups may have lost all of their
+    // members since they last committed
+    const vector<ConsumerOffset> consumer_offsets =
+        offset_store->get_ready_topic_consumer_offsets(topic, partition);
+    for (const ConsumerOffset& consumer_offset : consumer_offsets) {
+        const int64_t committed_offset = consumer_offset.get_topic_partition().get_offset();
+        update_lag(topic, partition, consumer_offset.get_group_id(), committed_offset, offset);
     }
     Handler::handle_topic_message(topic, partition, offset);
 }
 
+void LagTrackerHandler::update_lag(const string& topic, int partition, const string& group_id,
+                                   int64_t committed_offset, int64_t topic_offset) {
+    handle_lag_update(topic, partition, group_id, max<int64_t>(0, topic_offset - committed_offset));
+    // This only looks at the store's history so no requests are made to the brokers
+    const optional<milliseconds> time_lag =
+        get_offset_store()->get_time_lag(topic, partition, committed_offset);
+    if (time_lag) {
+        handle_time_lag_update(topic, partition, group_id, *time_lag);
+    }
+}
+
 } // api
 } // pirulo
@@ -1,4 +1,5 @@
 #include <tuple>
+#include <unordered_set>
 #include <cppkafka/metadata.h>
 #include "topic_offset_reader.h"
 #include "detail/logging.h"
@@ -12,10 +13,16 @@ using std::lock_guard;
 using std::mutex;
 using std::tie;
 using std::ignore;
+using std::vector;
+using std::min;
+using std::max;
 
 using std::this_thread::sleep_for;
 
 using std::chrono::seconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::chrono::duration;
 
 using cppkafka::Consumer;
 using cppkafka::Message;
@@ -29,6 +36,11 @@ namespace pirulo {
 
 PIRULO_CREATE_LOGGER("p.topics");
 
+static const milliseconds TIMESTAMP_FETCH_TIMEOUT{1000};
+// Partitions waiting for their timestamps to be fetched. Refreshes that find the queue full
+// are skipped, the next refresh of that partition will try again
+static const size_t MAXIMUM_TIMESTAMP_TASKS = 1000;
+
 static Configuration prepare_config(Configuration config) {
     config.set("group.id", utils::generate_group_id());
     LOG4CXX_INFO(logger, "Using consumer " << config.get("group.id") << " for "
@@ -39,8 +51,10 @@ static Configuration prepare_config(Configuration config) {
 TopicOffsetReader::TopicOffsetReader(StorePtr store, size_t thread_count,
                                      ConsumerOffsetReaderPtr consumer_reader,
                                      Configuration config)
-: consumer_pool_(thread_count, prepare_config(move(config))),store_(move(store)),
-  thread_pool_(thread_count), consumer_offset_reader_(move(consumer_reader)) {
+: consumer_pool_(thread_count, prepare_config(config)), timestamp_config_(move(config)),
+  store_(move(store)), thread_pool_(thread_count),
+  consumer_offset_reader_(move(consumer_reader)),
+  timestamp_thread_(1, MAXIMUM_TIMESTAMP_TASKS) {
 
 }
 
@@ -59,12 +73,43 @@ void TopicOffsetReader::run() {
 void TopicOffsetReader::stop() {
     running_ = false;
     thread_pool_.stop();
+    timestamp_thread_.stop();
+}
+
+void TopicOffsetReader::enable_timestamp_sampling(double maximum_fetches_per_second) {
+    if (maximum_fetches_per_second > 0 && !timestamp_consumer_) {
+        timestamp_config_.set("group.id", utils::generate_group_id());
+        timestamp_consumer_.reset(new Consumer(timestamp_config_));
+    }
+    lock_guard<mutex> _(fetch_budget_mutex_);
+    maximum_fetches_per_second_ = maximum_fetches_per_second;
+    available_fetches_ = maximum_fetches_per_second;
+    last_fetch_refill_ = steady_clock::now();
+}
+
+void TopicOffsetReader::set_deleted_topic_ttl(seconds ttl) {
+    deleted_topic_ttl_ = ttl;
 }
 
 TopicOffsetReader::StorePtr TopicOffsetReader::get_store() const {
     return store_;
 }
 
+vector<MemoryUsage> TopicOffsetReader::get_memory_usage() const {
+    vector<MemoryUsage> output;
+    output.push_back({ "scheduled tasks", task_scheduler_.get_task_count(),
+                       task_scheduler_.get_memory_usage() });
+    lock_guard<mutex> _(monitored_topics_mutex_);
+    size_t monitored_bytes = memory::get_heap_size(monitored_topic_task_id_) +
+                             memory::get_heap_size(missing_topics_);
+    for (const auto& task_pair : monitored_topic_task_id_) {
+        monitored_bytes += memory::get_heap_size(task_pair.first);
+    }
+    output.push_back({ "monitored partitions", monitored_topic_task_id_.size(),
+                       monitored_bytes });
+    return output;
+}
+
 void TopicOffsetReader::async_process_topics(const TopicPartitionCount& topics) {
     LOG4CXX_INFO(logger, "Fetching offsets for " << topics.size() << " topics");
     for (const auto& topic_pair : topics) {
@@ -92,7 +137,10 @@ void TopicOffsetReader::monitor_topics(const TopicPartitionList& topics) {
         auto task_id = task_scheduler_.add_task(move(task), maximum_topic_reload_time_);
 
         // Mark it as monitored
-        monitored_topic_task_id_.emplace(topic_partition, task_id);
+        {
+            lock_guard<mutex> _(monitored_topics_mutex_);
+            monitored_topic_task_id_.emplace(topic_partition, task_id);
+        }
 
         // Watch for commits on this topic
         auto commit_callback = [&](const string& topic, int partition) {
@@ -107,6 +155,7 @@ void TopicOffsetReader::monitor_topics(const TopicPartitionList& topics) {
 void TopicOffsetReader::monitor_new_topics() {
     auto task = [&] {
         process_metadata([&](const TopicPartitionCount& counts) {
+            remove_deleted_topics(counts);
             const TopicPartitionList new_topics = get_new_topic_partitions(counts);
             if (!new_topics.empty()) {
                 LOG4CXX_INFO(logger, "Found " << new_topics.size() << " new topic/partitions "
@@ -120,6 +169,7 @@ void TopicOffsetReader::monitor_new_topics() {
 
 TopicPartitionList TopicOffsetReader::get_new_topic_partitions(const TopicPartitionCount& counts) {
     TopicPartitionList output;
+    lock_guard<mutex> _(monitored_topics_mutex_);
     for (const auto& topic_count_pair : counts) {
         const string& topic = topic_count_pair.first;
         for (size_t i = 0; i < topic_count_pair.second; ++i) {
@@ -132,6 +182,51 @@ TopicPartitionList TopicOffsetReader::get_new_topic_partitions(const TopicPartit
     return output;
 }
 
+void TopicOffsetReader::remove_deleted_topics(const TopicPartitionCount& counts) {
+    const auto now = steady_clock::now();
+    set<string> deleted_topics;
+    {
+        lock_guard<mutex> _(monitored_topics_mutex_);
+        for (const auto& task_pair : monitored_topic_task_id_) {
+            const string& topic = task_pair.first.get_topic();
+            if (counts.count(topic)) {
+                continue;
+            }
+            // Give topics some time to show up again before removing them
+            auto iter = missing_topics_.emplace(topic, now).first;
+            if (now - iter->second >= deleted_topic_ttl_) {
+                deleted_topics.emplace(topic);
+            }
+        }
+        auto iter = monitored_topic_task_id_.begin();
+        while (iter != monitored_topic_task_id_.end()) {
+            const TopicPartition& topic_partition = iter->first;
+            if (deleted_topics.count(topic_partition.get_topic())) {
+                task_scheduler_.remove_task(iter->second);
+                consumer_offset_reader_->unwatch_commits(topic_partition.get_topic(),
+                                                         topic_partition.get_partition());
+                iter = monitored_topic_task_id_.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+    auto iter = missing_topics_.begin();
+    while (iter != missing_topics_.end()) {
+        if (counts.count(iter->first) || deleted_topics.count(iter->first)) {
+            iter = missing_topics_.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+    for (const string& topic : deleted_topics) {
+        LOG4CXX_INFO(logger, "Topic " << topic << " was deleted, removing it");
+        store_->remove_topic(topic);
+    }
+}
+
 TopicOffsetReader::TopicPartitionCount TopicOffsetReader::load_metadata() {
     // Load all existing topic names
     TopicPartitionCount topics;
@@ -164,22 +259,122 @@ void TopicOffsetReader::process_topic_partition(const TopicPartition& topic_part
     try {
         consumer_pool_.acquire_consumer([&](Consumer& consumer) {
             tie(ignore, offset) = consumer.query_offsets(topic_partition);
-            store_->store_topic_offset(topic_partition.get_topic(),
-                                       topic_partition.get_partition(), offset);
         });
     }
     catch (const cppkafka::Exception& ex) {
         LOG4CXX_ERROR(logger, "Failed to fetch offsets for " << topic_partition
                       << ": " << ex.what());
+        return;
+    }
+    store_->store_topic_offset(topic_partition.get_topic(), topic_partition.get_partition(),
+                               offset);
+    sample_message_timestamps(topic_partition, offset);
+}
+
+void TopicOffsetReader::sample_message_timestamps(const TopicPartition& topic_partition,
+                                                  int64_t topic_offset) {
+    {
+        lock_guard<mutex> _(fetch_budget_mutex_);
+        if (maximum_fetches_per_second_ <= 0) {
+            return;
+        }
+    }
+    const string& topic = topic_partition.get_topic();
+    const int partition = topic_partition.get_partition();
+    // Groups tend to sit at the same offsets, go through each of them once
+    set<int64_t> offsets;
+    for (const ConsumerOffset& consumer_offset :
+         store_->get_topic_consumer_offsets(topic, partition)) {
+        const int64_t offset = consumer_offset.get_topic_partition().get_offset();
+        // Groups that caught up have no time lag
+        if (offset >= 0 && offset < topic_offset &&
+            !store_->get_message_timestamp(topic, partition, offset)) {
+            offsets.emplace(offset);
+        }
+    }
+    if (offsets.empty()) {
+        return;
+    }
+    auto task = [this, topic_partition, offsets] {
+        fetch_message_timestamps(topic_partition, offsets);
+    };
+    if (!timestamp_thread_.add_task(move(task))) {
+        LOG4CXX_TRACE(logger, "Too many pending timestamp fetches, not sampling timestamps "
+                      "for " << topic_partition);
+    }
+}
+
+void TopicOffsetReader::fetch_message_timestamps(const TopicPartition& topic_partition,
+                                                 const set<int64_t>& offsets) {
+    const string& topic = topic_partition.get_topic();
+    const int partition = topic_partition.get_partition();
+    for (const int64_t offset : offsets) {
+        // An earlier fetch may have covered it since this was queued
+        if (store_->get_message_timestamp(topic, partition, offset)) {
+            continue;
+        }
+        if (!acquire_fetch()) {
+            LOG4CXX_TRACE(logger, "Fetch budget exhausted, not sampling timestamps for "
+                          << topic_partition);
+            return;
+        }
+        fetch_message_timestamp({ topic, partition, offset });
+    }
+}
+
+void TopicOffsetReader::fetch_message_timestamp(const TopicPartition& message) {
+    LOG4CXX_TRACE(logger, "Fetching message timestamp for " << message);
+    Consumer& consumer = *timestamp_consumer_;
+    try {
+        consumer.assign({ message });
+        Message msg = consumer.poll(TIMESTAMP_FETCH_TIMEOUT);
+        if (msg && msg.get_error() && !msg.is_eof()) {
+            LOG4CXX_DEBUG(logger, "Failed to fetch message timestamp for " << message
+                          << ": " << msg.get_error().to_string());
+        }
+        else if (msg && !msg.get_error() && msg.get_timestamp()) {
+            // The offset may have been compacted away or hold a transaction marker, in which
+            // case the next message is returned. Store it under its own offset
+            if (msg.get_offset() != message.get_offset()) {
+                LOG4CXX_DEBUG(logger, "Fetched offset " << msg.get_offset() << " rather than "
+                              << message);
+            }
+            store_->store_message_timestamp(message.get_topic(), message.get_partition(),
+                                            msg.get_offset(),
+                                            msg.get_timestamp()->get_timestamp().count());
+        }
+        consumer.unassign();
+    }
+    catch (const cppkafka::Exception& ex) {
+        LOG4CXX_ERROR(logger, "Failed to fetch message timestamp for " << message
+                      << ": " << ex.what());
+    }
+}
+
+bool TopicOffsetReader::acquire_fetch() {
+    lock_guard<mutex> _(fetch_budget_mutex_);
+    const auto now = steady_clock::now();
+    const duration<double> elapsed = now - last_fetch_refill_;
+    last_fetch_refill_ = now;
+    // Allow at least one fetch to build up even on rates below one per second
+    available_fetches_ = min(max(maximum_fetches_per_second_, 1.0),
+                             available_fetches_ + elapsed.count() * maximum_fetches_per_second_);
+    if (available_fetches_ < 1) {
+        return false;
     }
+    available_fetches_ -= 1;
+    return true;
 }
 
 void TopicOffsetReader::on_commit(const string& topic, int partition) {
     TopicPartition topic_partition(topic, partition);
     LOG4CXX_TRACE(logger, "Bumping up priority of offset loading for " << topic_partition);
-    // Increase the priority for this task
-    auto task_id = monitored_topic_task_id_.at(topic_partition);
-    task_scheduler_.set_priority(task_id, 0.0);
+    // Increase the priority for this task. Keep the lock so it's not removed meanwhile
+    lock_guard<mutex> _(monitored_topics_mutex_);
+    auto iter = monitored_topic_task_id_.find(topic_partition);
+    if (iter != monitored_topic_task_id_.end()) {
+        task_scheduler_.set_priority(iter->second, 0.0);
+    }
 }
 
 } // pirulo
@@ -0,0 +1,26 @@
+#include "utils/memory_usage.h"
+
+using std::string;
+
+using cppkafka::TopicPartition;
+
+namespace pirulo {
+
+bool MemoryUsage::operator==(const MemoryUsage& rhs) const {
+    return name == rhs.name && entries == rhs.entries && bytes == rhs.bytes;
+}
+
+namespace memory {
+
+size_t get_heap_size(const string& value) {
+    // An empty string's capacity is the size of its small string buffer
+    static const size_t small_string_capacity = string().capacity();
+    return value.capacity() > small_string_capacity ? value.capacity() + 1 : 0;
+}
+
+size_t get_heap_size(const TopicPartition& value) {
+    return get_heap_size(value.get_topic());
+}
+
+} // memory
+} // pirulo
@@ -0,0 +1,93 @@
+#include <boost/functional/hash.hpp>
+#include "utils/string_interner.h"
+#include "utils/memory_usage.h"
+
+using std::string;
+using std::shared_ptr;
+using std::make_shared;
+using std::lock_guard;
+using std::mutex;
+
+using boost::string_ref;
+
+namespace pirulo {
+
+const string& StringInterner::intern(string_ref value) {
+    auto iter = indexes_.find(value);
+    if (iter != indexes_.end()) {
+        return *iter->second;
+    }
+    strings_.emplace_back(value.begin(), value.end());
+    const string& output = strings_.back();
+    // Index it using a view into our own copy rather than the one we were given
+    indexes_.emplace(string_ref(output), &output);
+    return output;
+}
+
+void StringInterner::clear() {
+    indexes_.clear();
+    strings_.clear();
+}
+
+size_t StringInterner::size() const {
+    return strings_.size();
+}
+
+// Reference counts, deleter and the pointer to the state
+static constexpr size_t CONTROL_BLOCK_SIZE = 5 * sizeof(void*);
+
+static size_t get_string_bytes(const string& value) {
+    return sizeof(string) + memory::get_heap_size(value) + CONTROL_BLOCK_SIZE;
+}
+
+SharedStringInterner::SharedStringInterner()
+: state_(make_shared<State>()) {
+
+}
+
+SharedStringInterner::StringPtr SharedStringInterner::intern(string_ref value) {
+    lock_guard<mutex> _(state_->mutex);
+    auto iter = state_->indexes.find(value);
+    if (iter != state_->indexes.end()) {
+        StringPtr output = iter->second.lock();
+        if (output) {
+            return output;
+        }
+        // Its last reference is going away right now. Replace it, the release will see the
+        // entry no longer points to it
+        state_->indexes.erase(iter);
+    }
+    shared_ptr<State> state = state_;
+    StringPtr output(new string(value.begin(), value.end()), [state](const string* ptr) {
+        state->release(ptr);
+        delete ptr;
+    });
+    state_->indexes.emplace(string_ref(*output), output);
+    state_->string_bytes += get_string_bytes(*output);
+    return output;
+}
+
+size_t SharedStringInterner::size() const {
+    lock_guard<mutex> _(state_->mutex);
+    return state_->indexes.size();
+}
+
+size_t SharedStringInterner::get_memory_usage() const {
+    lock_guard<mutex> _(state_->mutex);
+    return memory::get_heap_size(state_->indexes) + state_->string_bytes;
+}
+
+void SharedStringInterner::State::release(const string* value) {
+    lock_guard<std::mutex> _(mutex);
+    string_bytes -= get_string_bytes(*value);
+    auto iter = indexes.find(*value);
+    if (iter != indexes.end() && iter->first.data() == value->data()) {
+        indexes.erase(iter);
+    }
+}
+
+size_t StringViewHasher::operator()(string_ref value) const {
+    return boost::hash_range(value.begin(), value.end());
+}
+
+} // pirulo
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include "utils/task_scheduler.h"
 #include "exceptions.h"
+#include "utils/memory_usage.h"
 #include "detail/logging.h"
 
 using std::lock_guard;
@@ -87,6 +88,16 @@ void TaskScheduler::set_minimum_reschedule_time(Duration value) {
     minimum_reschedule_ = value;
 }
 
+size_t TaskScheduler::get_task_count() const {
+    lock_guard<mutex> _(tasks_mutex_);
+    return tasks_.size();
+}
+
+size_t TaskScheduler::get_memory_usage() const {
+    lock_guard<mutex> _(tasks_mutex_);
+    return memory::get_heap_size(tasks_) + memory::get_heap_size(tasks_queue_);
+}
+
 void TaskScheduler::stop() {
     {
         lock_guard<mutex> _(tasks_mutex_);
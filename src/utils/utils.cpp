@@ -1,12 +1,16 @@
 #include <random>
 #include <array>
+#include <cstdint>
+#include <cstdlib>
 #include "utils/utils.h"
+#include "exceptions.h"
 
 using std::string;
 using std::array;
 using std::random_device;
 using std::mt19937;
 using std::uniform_int_distribution;
+using std::abs;
 
 namespace pirulo {
 namespace utils {
@@ -32,6 +36,62 @@ string generate_group_id() {
     return output;
 }
 
+// Java hashes strings as UTF-16 code units, so the group id needs to be decoded first
+static int32_t java_string_hash(const string& value) {
+    uint32_t output = 0;
+    auto add_unit = [&](uint32_t unit) {
+        output = output * 31 + unit;
+    };
+    size_t i = 0;
+    while (i < value.size()) {
+        const uint8_t lead = value[i];
+        size_t length = 1;
+        uint32_t code_point = lead;
+        if (lead >= 0xf0) {
+            length = 4;
+            code_point = lead & 0x07;
+        }
+        else if (lead >= 0xe0) {
+            length = 3;
+            code_point = lead & 0x0f;
+        }
+        else if (lead >= 0xc0) {
+            length = 2;
+            code_point = lead & 0x1f;
+        }
+        // Treat truncated sequences as single bytes
+        if (i + length > value.size()) {
+            length = 1;
+            code_point = lead;
+        }
+        for (size_t j = 1; j < length; ++j) {
+            code_point = (code_point << 6) | (static_cast<uint8_t>(value[i + j]) & 0x3f);
+        }
+        i += length;
+
+        if (code_point >= 0x10000) {
+            // Split it into a surrogate pair
+            code_point -= 0x10000;
+            add_unit(0xd800 + (code_point >> 10));
+            add_unit(0xdc00 + (code_point & 0x3ff));
+        }
+        else {
+            add_unit(code_point);
+        }
+    }
+    return static_cast<int32_t>(output);
+}
+
+int get_group_offsets_partition(const string& group_id, int partition_count) {
+    if (partition_count <= 0) {
+        throw Exception("Invalid __consumer_offsets partition count");
+    }
+    const int32_t hash = java_string_hash(group_id);
+    // Same as kafka's Utils.abs
+    const int32_t absolute_hash = hash == INT32_MIN ? 0 : abs(hash);
+    return absolute_hash % partition_count;
+}
+
 } // utils
 } // pirulo
 
@@ -0,0 +1,160 @@
+#include <vector>
+#include <string>
+#include <gtest/gtest.h>
+#include "consumer_offset_reader.h"
+#include "exceptions.h"
+
+using std::vector;
+using std::string;
+
+using cppkafka::Buffer;
+
+using pirulo::ConsumerOffsetReader;
+using pirulo::ParseException;
+
+using ConsumerGroupState = pirulo::OffsetStore::ConsumerGroupState;
+
+class GroupMetadataTest : public testing::Test {
+public:
+    // Builds group metadata values the way the broker writes them
+    class ValueBuilder {
+    public:
+        ValueBuilder(uint16_t version)
+        : version_(version) {
+            write_be(version, 2);
+        }
+
+        ValueBuilder& write_be(uint64_t value, size_t size) {
+            for (size_t i = size; i > 0; --i) {
+                data_.push_back(static_cast<uint8_t>(value >> ((i - 1) * 8)));
+            }
+            return *this;
+        }
+
+        ValueBuilder& write_unsigned_varint(uint32_t value) {
+            while (value >= 0x80) {
+                data_.push_back(static_cast<uint8_t>(value) | 0x80);
+                value >>= 7;
+            }
+            data_.push_back(static_cast<uint8_t>(value));
+            return *this;
+        }
+
+        ValueBuilder& write_string(const string& value) {
+            if (is_flexible()) {
+                write_unsigned_varint(value.size() + 1);
+            }
+            else {
+                write_be(value.size(), 2);
+            }
+            data_.insert(data_.end(), value.begin(), value.end());
+            return *this;
+        }
+
+        ValueBuilder& write_null_string() {
+            if (is_flexible()) {
+                return write_unsigned_varint(0);
+            }
+            return write_be(0xffff, 2);
+        }
+
+        // Everything up to the members array
+        ValueBuilder& write_header(const string& protocol_type, const string& leader) {
+            write_string(protocol_type);
+            write_be(5, 4);
+            write_string("range");
+            write_string(leader);
+            if (version_ >= 2) {
+                write_be(1600000000000, 8);
+            }
+            return *this;
+        }
+
+        // Writes the array's size followed by some bytes standing for the members, which
+        // aren't parsed
+        ValueBuilder& write_members(uint32_t count) {
+            if (is_flexible()) {
+                write_unsigned_varint(count + 1);
+            }
+            else {
+                write_be(count, 4);
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                write_string("member-" + std::to_string(i));
+            }
+            return *this;
+        }
+
+        Buffer get_buffer() const {
+            return Buffer(data_.data(), data_.size());
+        }
+    private:
+        bool is_flexible() const {
+            return version_ >= 4;
+        }
+
+        vector<uint8_t> data_;
+        uint16_t version_;
+    };
+
+    // Values are never parsed as UNKNOWN, so it stands for unknown versions
+    static ConsumerGroupState parse(const ValueBuilder& builder) {
+        const auto state = ConsumerOffsetReader::parse_group_metadata(builder.get_buffer());
+        return state ? *state : ConsumerGroupState::UNKNOWN;
+    }
+};
+
+TEST_F(GroupMetadataTest, EveryVersion) {
+    for (uint16_t version = 0; version <= 4; ++version) {
+        SCOPED_TRACE(version);
+        ValueBuilder active(version);
+        active.write_header("consumer", "member-0").write_members(2);
+        EXPECT_EQ(ConsumerGroupState::ACTIVE, parse(active));
+
+        ValueBuilder empty(version);
+        empty.write_header("consumer", "").write_members(0);
+        EXPECT_EQ(ConsumerGroupState::EMPTY, parse(empty));
+    }
+}
+
+TEST_F(GroupMetadataTest, NullStrings) {
+    for (uint16_t version = 0; version <= 4; ++version) {
+        SCOPED_TRACE(version);
+        ValueBuilder builder(version);
+        builder.write_string("consumer").write_be(0, 4).write_null_string().write_null_string();
+        if (version >= 2) {
+            builder.write_be(0, 8);
+        }
+        builder.write_members(1);
+        EXPECT_EQ(ConsumerGroupState::ACTIVE, parse(builder));
+    }
+}
+
+TEST_F(GroupMetadataTest, MultiByteCompactLengths) {
+    // Both lengths take two bytes as varints
+    ValueBuilder builder(4);
+    builder.write_header(string(300, 'p'), "member-0").write_members(200);
+    EXPECT_EQ(ConsumerGroupState::ACTIVE, parse(builder));
+}
+
+TEST_F(GroupMetadataTest, NullCompactMembers) {
+    ValueBuilder builder(4);
+    builder.write_header("consumer", "").write_unsigned_varint(0);
+    EXPECT_EQ(ConsumerGroupState::EMPTY, parse(builder));
+}
+
+TEST_F(GroupMetadataTest, UnknownVersion) {
+    ValueBuilder builder(5);
+    builder.write_header("consumer", "member-0").write_members(1);
+    EXPECT_EQ(ConsumerGroupState::UNKNOWN, parse(builder));
+}
+
+TEST_F(GroupMetadataTest, Truncated) {
+    for (uint16_t version = 0; version <= 4; ++version) {
+        SCOPED_TRACE(version);
+        ValueBuilder builder(version);
+        builder.write_header("consumer", "member-0");
+        EXPECT_THROW(ConsumerOffsetReader::parse_group_metadata(builder.get_buffer()),
+                     ParseException);
+    }
+}
@@ -0,0 +1,110 @@
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <gtest/gtest.h>
+#include "utils/indexed_heap.h"
+
+using std::vector;
+using std::sort;
+using std::mt19937;
+
+using pirulo::IndexedHeap;
+
+struct Element {
+    int key{0};
+    size_t heap_index{IndexedHeap<Element, int>::NOT_IN_HEAP};
+};
+
+using ElementHeap = IndexedHeap<Element, int>;
+
+class IndexedHeapTest : public testing::Test {
+public:
+    // Keys of the elements in the heap, largest first
+    static vector<int> get_expected_keys(const vector<Element>& elements) {
+        vector<int> output;
+        for (const Element& element : elements) {
+            if (element.heap_index != ElementHeap::NOT_IN_HEAP) {
+                output.push_back(element.key);
+            }
+        }
+        sort(output.rbegin(), output.rend());
+        return output;
+    }
+
+    static vector<int> get_keys(const ElementHeap& heap, size_t count) {
+        vector<int> output;
+        for (const Element* element : heap.get_largest(count)) {
+            output.push_back(element->key);
+        }
+        return output;
+    }
+};
+
+TEST_F(IndexedHeapTest, GetLargest) {
+    vector<Element> elements(5);
+    ElementHeap heap;
+    const vector<int> keys = { 3, 9, 1, 7, 5 };
+    for (size_t i = 0; i < keys.size(); ++i) {
+        elements[i].key = keys[i];
+        heap.update(&elements[i], keys[i]);
+    }
+    EXPECT_EQ(5u, heap.size());
+    EXPECT_EQ(vector<int>({ 9, 7, 5 }), get_keys(heap, 3));
+    EXPECT_EQ(vector<int>({ 9, 7, 5, 3, 1 }), get_keys(heap, 10));
+    EXPECT_TRUE(get_keys(heap, 0).empty());
+}
+
+TEST_F(IndexedHeapTest, Update) {
+    vector<Element> elements(3);
+    ElementHeap heap;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        heap.update(&elements[i], static_cast<int>(i));
+    }
+    // Moving an element up and down keeps it in the heap only once
+    heap.update(&elements[0], 10);
+    EXPECT_EQ(3u, heap.size());
+    EXPECT_EQ(&elements[0], heap.get_largest(1)[0]);
+    heap.update(&elements[0], -1);
+    EXPECT_EQ(3u, heap.size());
+    EXPECT_EQ(&elements[2], heap.get_largest(1)[0]);
+}
+
+TEST_F(IndexedHeapTest, Remove) {
+    vector<Element> elements(3);
+    ElementHeap heap;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        heap.update(&elements[i], static_cast<int>(i));
+    }
+    heap.remove(&elements[2]);
+    EXPECT_EQ(ElementHeap::NOT_IN_HEAP, elements[2].heap_index);
+    EXPECT_EQ(2u, heap.size());
+    EXPECT_EQ(&elements[1], heap.get_largest(1)[0]);
+    // Removing it again does nothing
+    heap.remove(&elements[2]);
+    EXPECT_EQ(2u, heap.size());
+    heap.remove(&elements[0]);
+    heap.remove(&elements[1]);
+    EXPECT_EQ(0u, heap.size());
+    EXPECT_TRUE(heap.get_largest(1).empty());
+}
+
+TEST_F(IndexedHeapTest, RandomOperations) {
+    mt19937 generator(1);
+    vector<Element> elements(200);
+    ElementHeap heap;
+    for (int i = 0; i < 20000; ++i) {
+        Element& element = elements[generator() % elements.size()];
+        if (generator() % 3 == 0) {
+            heap.remove(&element);
+        }
+        else {
+            element.key = static_cast<int>(generator() % 1000);
+            heap.update(&element, element.key);
+        }
+        if (i % 100 == 0) {
+            const vector<int> expected = get_expected_keys(elements);
+            ASSERT_EQ(expected.size(), heap.size());
+            ASSERT_EQ(expected, get_keys(heap, expected.size()));
+        }
+    }
+}
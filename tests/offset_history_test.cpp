@@ -0,0 +1,116 @@
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <boost/optional/optional_io.hpp>
+#include <gtest/gtest.h>
+#include "offset_history.h"
+
+using std::vector;
+using std::numeric_limits;
+
+using boost::optional;
+
+using pirulo::OffsetHistory;
+
+using Sample = OffsetHistory::Sample;
+
+class OffsetHistoryTest : public testing::Test {
+public:
+    static const int64_t MINIMUM_TIMESTAMP = numeric_limits<int64_t>::min();
+    static const int64_t MAXIMUM_TIMESTAMP = numeric_limits<int64_t>::max();
+
+    static vector<Sample> get_all_samples(const OffsetHistory& history) {
+        return history.get_samples(MINIMUM_TIMESTAMP, MAXIMUM_TIMESTAMP);
+    }
+};
+
+TEST_F(OffsetHistoryTest, RoundTrip) {
+    OffsetHistory history(1024 * 1024);
+    vector<Sample> samples;
+    int64_t timestamp = 1600000000000;
+    int64_t offset = 0;
+    for (int i = 0; i < 1000; ++i) {
+        // Irregular deltas, including offsets going backwards and large jumps
+        timestamp += 1000 + (i % 7) * 13;
+        offset += (i % 11 == 0) ? -50 : (i % 13 == 0 ? (int64_t(1) << 40) : i);
+        history.add_sample(timestamp, offset);
+        samples.push_back({ timestamp, offset });
+    }
+    EXPECT_EQ(samples, get_all_samples(history));
+}
+
+TEST_F(OffsetHistoryTest, SamplesInRange) {
+    OffsetHistory history(1024);
+    for (int i = 0; i < 10; ++i) {
+        history.add_sample(i * 100, i * 10);
+    }
+    const vector<Sample> expected = { { 300, 30 }, { 400, 40 }, { 500, 50 } };
+    EXPECT_EQ(expected, history.get_samples(250, 500));
+}
+
+TEST_F(OffsetHistoryTest, OlderSamplesAreIgnored) {
+    OffsetHistory history(1024);
+    history.add_sample(100, 10);
+    history.add_sample(50, 20);
+    const vector<Sample> expected = { { 100, 10 } };
+    EXPECT_EQ(expected, get_all_samples(history));
+}
+
+TEST_F(OffsetHistoryTest, OldestSamplesAreDropped) {
+    const size_t maximum_size = 1024;
+    OffsetHistory history(maximum_size);
+    const int count = 100000;
+    for (int i = 0; i < count; ++i) {
+        history.add_sample(i * 1000, i * 50);
+    }
+    const vector<Sample> samples = get_all_samples(history);
+    ASSERT_FALSE(samples.empty());
+    ASSERT_LT(samples.size(), static_cast<size_t>(count));
+    // What's left is the latest samples
+    EXPECT_EQ((Sample{ (count - 1) * 1000, (count - 1) * 50 }), samples.back());
+    for (size_t i = 1; i < samples.size(); ++i) {
+        EXPECT_EQ(samples[i - 1].timestamp + 1000, samples[i].timestamp);
+    }
+    EXPECT_LE(history.get_size(), maximum_size * 2);
+}
+
+TEST_F(OffsetHistoryTest, FindTimestamp) {
+    OffsetHistory history(1024);
+    history.add_sample(1000, 100);
+    history.add_sample(2000, 200);
+    history.add_sample(3000, 400);
+    EXPECT_EQ(optional<int64_t>(1000), history.find_timestamp(100));
+    EXPECT_EQ(optional<int64_t>(1500), history.find_timestamp(150));
+    EXPECT_EQ(optional<int64_t>(2500), history.find_timestamp(300));
+    // Reached before the series starts
+    EXPECT_FALSE(history.find_timestamp(50));
+    // Not reached yet
+    EXPECT_FALSE(history.find_timestamp(400));
+    EXPECT_FALSE(history.find_timestamp(500));
+}
+
+TEST_F(OffsetHistoryTest, FindTimestampUsesLatestCrossing) {
+    OffsetHistory history(1024);
+    history.add_sample(1000, 100);
+    history.add_sample(2000, 300);
+    // The topic was recreated
+    history.add_sample(3000, 0);
+    history.add_sample(4000, 200);
+    EXPECT_EQ(optional<int64_t>(3500), history.find_timestamp(100));
+}
+
+TEST_F(OffsetHistoryTest, FindTimestampAcrossBlocks) {
+    // Small enough that the samples span many blocks
+    OffsetHistory history(256);
+    for (int i = 0; i < 1000; ++i) {
+        history.add_sample(i * 1000, i * 10);
+    }
+    const vector<Sample> samples = get_all_samples(history);
+    ASSERT_GT(samples.size(), 2u);
+    for (size_t i = 0; i + 1 < samples.size(); ++i) {
+        EXPECT_EQ(optional<int64_t>(samples[i].timestamp), history.find_timestamp(samples[i].offset));
+        EXPECT_EQ(optional<int64_t>(samples[i].timestamp + 500),
+                  history.find_timestamp(samples[i].offset + 5));
+    }
+    EXPECT_FALSE(history.find_timestamp(samples.front().offset - 1));
+}
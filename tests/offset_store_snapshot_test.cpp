@@ -0,0 +1,126 @@
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <boost/optional/optional_io.hpp>
+#include <gtest/gtest.h>
+#include "offset_store.h"
+#include "offset_store_snapshot.h"
+#include "exceptions.h"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::pair;
+using std::sort;
+using std::make_pair;
+using std::remove;
+
+using boost::optional;
+
+using pirulo::OffsetStore;
+using pirulo::OffsetStoreSnapshot;
+using pirulo::ConsumerOffset;
+
+using ConsumerGroupState = OffsetStore::ConsumerGroupState;
+
+class OffsetStoreSnapshotTest : public testing::Test {
+public:
+    OffsetStoreSnapshotTest()
+    : path_(testing::TempDir() + "pirulo_snapshot_test") {
+        remove(path_.c_str());
+    }
+
+    ~OffsetStoreSnapshotTest() {
+        remove(path_.c_str());
+    }
+
+    using OffsetMap = map<pair<string, int>, int64_t>;
+
+    static OffsetMap get_offsets(const OffsetStore& store, const string& group_id) {
+        OffsetMap output;
+        for (const ConsumerOffset& consumer_offset : store.get_consumer_offsets(group_id)) {
+            const auto& topic_partition = consumer_offset.get_topic_partition();
+            output.emplace(make_pair(topic_partition.get_topic(),
+                                     topic_partition.get_partition()),
+                           topic_partition.get_offset());
+        }
+        return output;
+    }
+
+    static vector<string> get_consumers(const OffsetStore& store) {
+        vector<string> output = store.get_consumers();
+        sort(output.begin(), output.end());
+        return output;
+    }
+protected:
+    const string path_;
+};
+
+TEST_F(OffsetStoreSnapshotTest, RoundTrip) {
+    OffsetStore store;
+    store.store_consumer_offset("group-1", "topic-1", 0, 10);
+    store.store_consumer_offset("group-1", "topic-1", 1, 11);
+    store.store_consumer_offset("group-1", "topic-2", 0, 5);
+    store.store_consumer_offset("group-2", "topic-1", 0, 7);
+    store.remove_consumer_offset("group-2", "topic-1", 0);
+    store.store_consumer_offset("group-3", "topic-3", 3, 3);
+    store.store_topic_offset("topic-1", 0, 100);
+    store.store_topic_offset("topic-1", 1, 101);
+    store.store_topic_offset("topic-2", 0, 50);
+    store.set_consumer_offsets_position(4, 1234);
+    store.store_consumer_group_state("group-1", ConsumerGroupState::EMPTY);
+    store.store_consumer_group_state("group-3", ConsumerGroupState::ACTIVE);
+
+    const OffsetStoreSnapshot snapshot(path_);
+    snapshot.save(store);
+    OffsetStore loaded_store;
+    ASSERT_TRUE(snapshot.load(loaded_store));
+
+    EXPECT_EQ(vector<string>({ "group-1", "group-3" }), get_consumers(loaded_store));
+    EXPECT_EQ(get_offsets(store, "group-1"), get_offsets(loaded_store, "group-1"));
+    EXPECT_EQ(get_offsets(store, "group-3"), get_offsets(loaded_store, "group-3"));
+    EXPECT_EQ(3u, get_offsets(loaded_store, "group-1").size());
+    EXPECT_EQ(store.get_topic_offsets(), loaded_store.get_topic_offsets());
+    EXPECT_EQ(optional<int64_t>(101), loaded_store.get_topic_offset("topic-1", 1));
+    EXPECT_EQ(optional<int64_t>(1234), loaded_store.get_consumer_offsets_position(4));
+    EXPECT_EQ(ConsumerGroupState::EMPTY, loaded_store.get_consumer_state("group-1"));
+    EXPECT_EQ(ConsumerGroupState::ACTIVE, loaded_store.get_consumer_state("group-3"));
+    EXPECT_EQ(store.get_consumer_commit_timestamp("group-1"),
+              loaded_store.get_consumer_commit_timestamp("group-1"));
+}
+
+TEST_F(OffsetStoreSnapshotTest, KeepsCommitTimestamps) {
+    const string group_id = "group";
+    const string topic = "topic";
+    OffsetStore store;
+    store.store_consumer_offsets({ { group_id, topic, 0, 10, false, -1, 1000 } });
+
+    const OffsetStoreSnapshot snapshot(path_);
+    snapshot.save(store);
+    OffsetStore loaded_store;
+    ASSERT_TRUE(snapshot.load(loaded_store));
+    // Otherwise restarting would postpone the eviction of idle groups
+    EXPECT_EQ(1000, loaded_store.get_consumer_commit_timestamp(group_id));
+}
+
+TEST_F(OffsetStoreSnapshotTest, EmptyStore) {
+    OffsetStore store;
+    const OffsetStoreSnapshot snapshot(path_);
+    snapshot.save(store);
+    OffsetStore loaded_store;
+    ASSERT_TRUE(snapshot.load(loaded_store));
+    EXPECT_TRUE(loaded_store.get_consumers().empty());
+    EXPECT_TRUE(loaded_store.get_topic_offsets().empty());
+}
+
+TEST_F(OffsetStoreSnapshotTest, MissingSnapshot) {
+    OffsetStore store;
+    EXPECT_FALSE(OffsetStoreSnapshot(path_).load(store));
+}
+
+TEST_F(OffsetStoreSnapshotTest, SaveIntoMissingDirectory) {
+    OffsetStore store;
+    const OffsetStoreSnapshot snapshot(path_ + "/missing/snapshot");
+    EXPECT_THROW(snapshot.save(store), pirulo::Exception);
+}
@@ -0,0 +1,447 @@
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <boost/optional/optional_io.hpp>
+#include <gtest/gtest.h>
+#include "offset_store.h"
+
+using std::string;
+using std::vector;
+using std::set;
+using std::map;
+using std::tuple;
+using std::make_tuple;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::condition_variable;
+using std::sort;
+using std::to_string;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::duration_cast;
+using std::chrono::system_clock;
+
+using boost::optional;
+
+using pirulo::OffsetStore;
+using pirulo::ConsumerOffset;
+using pirulo::MemoryUsage;
+
+class OffsetStoreTest : public testing::Test {
+public:
+    static int64_t now() {
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    static void commit(OffsetStore& store, const string& group_id, const string& topic,
+                       int partition, int64_t offset, int64_t timestamp = 0) {
+        store.store_consumer_offsets({ { group_id, topic, partition, offset, false, -1,
+                                         timestamp } });
+    }
+
+    static optional<int64_t> get_offset(const OffsetStore& store, const string& group_id,
+                                        const string& topic, int partition) {
+        for (const ConsumerOffset& offset : store.get_consumer_offsets(group_id)) {
+            const auto& topic_partition = offset.get_topic_partition();
+            if (topic_partition.get_topic() == topic &&
+                topic_partition.get_partition() == partition) {
+                return topic_partition.get_offset();
+            }
+        }
+        return boost::none;
+    }
+
+    using LagMap = map<tuple<string, string, int>, int64_t>;
+
+    static LagMap get_lags(const OffsetStore::LagColumns& columns) {
+        LagMap output;
+        for (size_t i = 0; i < columns.lags.size(); ++i) {
+            output.emplace(make_tuple(*columns.group_ids[columns.group_indexes[i]],
+                                      *columns.topics[columns.topic_indexes[i]],
+                                      columns.partitions[i]),
+                           columns.lags[i]);
+        }
+        return output;
+    }
+
+    static vector<string> sorted(vector<string> values) {
+        sort(values.begin(), values.end());
+        return values;
+    }
+};
+
+TEST_F(OffsetStoreTest, RemoveInactiveConsumers) {
+    OffsetStore store;
+    commit(store, "old", "topic", 0, 10, now() - 60000);
+    commit(store, "recent", "topic", 0, 20, now());
+    store.publish();
+
+    EXPECT_EQ(vector<string>({ "old" }), store.remove_inactive_consumers(milliseconds(30000)));
+    store.publish();
+    EXPECT_TRUE(store.get_consumer_offsets("old").empty());
+    EXPECT_EQ(1u, store.get_consumer_offsets("recent").size());
+    EXPECT_EQ(vector<string>({ "recent" }), store.get_topic_consumers("topic"));
+
+    // Coming back makes it a regular group again
+    commit(store, "old", "topic", 0, 15, now());
+    store.publish();
+    EXPECT_EQ(vector<string>({ "old", "recent" }), sorted(store.get_topic_consumers("topic")));
+    EXPECT_TRUE(store.remove_inactive_consumers(milliseconds(30000)).empty());
+}
+
+TEST_F(OffsetStoreTest, RemoveTopic) {
+    OffsetStore store;
+    commit(store, "group", "removed", 0, 10);
+    commit(store, "group", "kept", 0, 20);
+    store.store_topic_offset("removed", 0, 100);
+    store.store_topic_offset("kept", 0, 200);
+    store.publish();
+
+    store.remove_topic("removed");
+    store.publish();
+    EXPECT_EQ(vector<string>({ "kept" }), store.get_topics());
+    EXPECT_FALSE(store.get_topic_offset("removed", 0));
+    EXPECT_TRUE(store.get_topic_consumers("removed").empty());
+    const vector<ConsumerOffset> offsets = store.get_consumer_offsets("group");
+    ASSERT_EQ(1u, offsets.size());
+    EXPECT_EQ("kept", offsets[0].get_topic_partition().get_topic());
+}
+
+TEST_F(OffsetStoreTest, ChangesSince) {
+    OffsetStore store;
+    store.store_consumer_offset("group-1", "topic", 0, 10);
+    store.store_consumer_offset("group-2", "topic", 0, 20);
+    store.store_topic_offset("topic", 0, 100);
+    store.publish();
+    const OffsetStore::ChangeSet all_changes = store.changes_since(0);
+    EXPECT_FALSE(all_changes.reset);
+    EXPECT_EQ(2u, all_changes.consumer_offsets.size());
+    EXPECT_EQ(1u, all_changes.topic_offsets.size());
+
+    store.store_consumer_offset("group-1", "topic", 0, 15);
+    store.store_topic_offset("topic", 1, 50);
+    store.publish();
+    const OffsetStore::ChangeSet changes = store.changes_since(all_changes.version);
+    EXPECT_FALSE(changes.reset);
+    ASSERT_EQ(1u, changes.consumer_offsets.size());
+    EXPECT_EQ("group-1", changes.consumer_offsets[0].get_group_id());
+    EXPECT_EQ(15, changes.consumer_offsets[0].get_topic_partition().get_offset());
+    ASSERT_EQ(1u, changes.topic_offsets.size());
+    EXPECT_EQ(1, changes.topic_offsets[0].get_partition());
+
+    const OffsetStore::ChangeSet no_changes = store.changes_since(changes.version);
+    EXPECT_TRUE(no_changes.consumer_offsets.empty());
+    EXPECT_TRUE(no_changes.topic_offsets.empty());
+}
+
+TEST_F(OffsetStoreTest, ChangesSinceRemovals) {
+    OffsetStore store;
+    store.store_consumer_offset("group", "topic", 0, 10);
+    store.store_consumer_offset("group", "topic", 1, 10);
+    store.store_topic_offset("removed", 0, 100);
+    store.publish();
+    const OffsetStore::Version version = store.changes_since(0).version;
+
+    store.remove_consumer_offset("group", "topic", 0);
+    store.remove_topic("removed");
+    store.publish();
+    const OffsetStore::ChangeSet changes = store.changes_since(version);
+    EXPECT_TRUE(changes.consumer_offsets.empty());
+    ASSERT_EQ(1u, changes.removed_consumer_offsets.size());
+    EXPECT_EQ(0, changes.removed_consumer_offsets[0].get_topic_partition().get_partition());
+    EXPECT_EQ(vector<string>({ "removed" }), changes.removed_topics);
+}
+
+TEST_F(OffsetStoreTest, ChangesSinceAfterGroupsMove) {
+    // Removing groups moves others to new ids within their shards
+    OffsetStore store;
+    for (int i = 0; i < 200; ++i) {
+        store.store_consumer_offset("group-" + to_string(i), "topic", 0, i);
+    }
+    store.publish();
+    const OffsetStore::Version version = store.changes_since(0).version;
+
+    for (int i = 0; i < 100; ++i) {
+        store.remove_consumer_offset("group-" + to_string(i), "topic", 0);
+    }
+    store.publish();
+    const OffsetStore::Version removal_version = store.changes_since(version).version;
+    for (int i = 100; i < 200; ++i) {
+        store.store_consumer_offset("group-" + to_string(i), "topic", 0, i + 1);
+    }
+    store.publish();
+    EXPECT_EQ(100u, store.changes_since(removal_version).consumer_offsets.size());
+    const OffsetStore::ChangeSet changes = store.changes_since(version);
+    EXPECT_EQ(100u, changes.consumer_offsets.size());
+    EXPECT_EQ(100u, changes.removed_consumer_offsets.size());
+}
+
+TEST_F(OffsetStoreTest, ChangesSinceUnknownVersion) {
+    // e.g. a version handed out before a restart that ran ahead of the clock
+    OffsetStore store;
+    store.store_consumer_offset("group", "topic", 0, 10);
+    store.publish();
+    const OffsetStore::ChangeSet changes = store.changes_since(store.changes_since(0).version +
+                                                               1000000000);
+    EXPECT_TRUE(changes.reset);
+    EXPECT_EQ(1u, changes.consumer_offsets.size());
+}
+
+TEST_F(OffsetStoreTest, MaximumHistorySize) {
+    const auto find_usage = [](const OffsetStore& store, const string& name) {
+        for (const MemoryUsage& usage : store.get_memory_usage()) {
+            if (usage.name == name) {
+                return usage;
+            }
+        }
+        return MemoryUsage{ name, 0, 0 };
+    };
+
+    // Room for two series
+    OffsetStore store;
+    store.set_history_size(4096);
+    store.set_maximum_history_size(8192);
+    store.store_topic_offset("topic", 0, 10);
+    store.store_topic_offset("topic", 1, 10);
+    store.store_topic_offset("topic", 2, 10);
+    EXPECT_EQ(1u, store.get_topic_offset_history("topic", 0, 0, now()).size());
+    EXPECT_EQ(1u, store.get_topic_offset_history("topic", 1, 0, now()).size());
+    EXPECT_TRUE(store.get_topic_offset_history("topic", 2, 0, now()).empty());
+    EXPECT_EQ(2u, find_usage(store, "reserved offset history").entries);
+    EXPECT_EQ(8192u, find_usage(store, "reserved offset history").bytes);
+
+    // Removing series makes room for new ones
+    store.remove_topic("topic");
+    EXPECT_EQ(0u, find_usage(store, "reserved offset history").bytes);
+    commit(store, "group", "other", 0, 10, now());
+    EXPECT_EQ(1u, store.get_consumer_offset_history("group", "other", 0, 0, now()).size());
+}
+
+TEST_F(OffsetStoreTest, StoreConsumerOffsetsAppliesUpdatesInOrder) {
+    // Coalesced commits are flushed in batches that can have the same key more than once,
+    // the latest one has to win
+    const vector<string> groups = { "group-1", "group-2", "group-3" };
+    const string topic = "topic";
+    OffsetStore store;
+    vector<OffsetStore::ConsumerOffsetUpdate> updates;
+    for (const string& group_id : groups) {
+        updates.push_back({ group_id, topic, 0, 10, false, -1, 0 });
+        updates.push_back({ group_id, topic, 1, 10, false, -1, 0 });
+    }
+    for (const string& group_id : groups) {
+        updates.push_back({ group_id, topic, 0, 20, false, -1, 0 });
+    }
+    // Removed and then committed again, and the other way around
+    updates.push_back({ groups[0], topic, 1, 0, true, -1, 0 });
+    updates.push_back({ groups[0], topic, 1, 30, false, -1, 0 });
+    updates.push_back({ groups[1], topic, 1, 0, true, -1, 0 });
+    store.store_consumer_offsets(updates);
+    store.publish();
+
+    for (const string& group_id : groups) {
+        EXPECT_EQ(optional<int64_t>(20), get_offset(store, group_id, topic, 0));
+    }
+    EXPECT_EQ(optional<int64_t>(30), get_offset(store, groups[0], topic, 1));
+    EXPECT_EQ(optional<int64_t>(), get_offset(store, groups[1], topic, 1));
+    EXPECT_EQ(optional<int64_t>(10), get_offset(store, groups[2], topic, 1));
+}
+
+TEST_F(OffsetStoreTest, PartitionReadiness) {
+    const string ready_group = "ready";
+    const string loading_group = "loading";
+    const string topic = "topic";
+    OffsetStore store;
+    store.store_consumer_offsets({ { ready_group, topic, 0, 10, false, 1, 0 },
+                                   { loading_group, topic, 0, 20, false, 2, 0 } });
+    store.set_consumer_offsets_partition_ready(1);
+    store.publish();
+
+    EXPECT_TRUE(store.is_consumer_ready(ready_group));
+    EXPECT_FALSE(store.is_consumer_ready(loading_group));
+    EXPECT_EQ(set<int>({ 1 }), store.get_ready_consumer_offsets_partitions());
+    EXPECT_EQ(2u, store.get_topic_consumer_offsets(topic, 0).size());
+    const vector<ConsumerOffset> offsets = store.get_ready_topic_consumer_offsets(topic, 0);
+    ASSERT_EQ(1u, offsets.size());
+    EXPECT_EQ(ready_group, offsets[0].get_group_id());
+
+    store.set_consumer_offsets_loaded();
+    EXPECT_TRUE(store.is_consumer_ready(loading_group));
+    EXPECT_EQ(2u, store.get_ready_topic_consumer_offsets(topic, 0).size());
+}
+
+TEST_F(OffsetStoreTest, NotificationsWaitForReadiness) {
+    const string group_id = "group";
+    const string topic = "topic";
+    mutex notified_mutex;
+    condition_variable notified_condition;
+    vector<string> notified;
+    OffsetStore store;
+    store.enable_notifications();
+    store.on_new_consumer([&](const string& group_id) {
+        lock_guard<mutex> _(notified_mutex);
+        notified.push_back(group_id);
+        notified_condition.notify_one();
+    });
+    store.store_consumer_offsets({ { group_id, topic, 0, 10, false, 3, 0 } });
+    {
+        unique_lock<mutex> lock(notified_mutex);
+        EXPECT_FALSE(notified_condition.wait_for(lock, milliseconds(100),
+                                                 [&] { return !notified.empty(); }));
+    }
+
+    // Groups that were held back are notified once their partition is loaded
+    store.set_consumer_offsets_partition_ready(3);
+    unique_lock<mutex> lock(notified_mutex);
+    EXPECT_TRUE(notified_condition.wait_for(lock, seconds(5),
+                                            [&] { return !notified.empty(); }));
+    EXPECT_EQ(vector<string>({ group_id }), notified);
+}
+
+TEST_F(OffsetStoreTest, TopicConsumers) {
+    OffsetStore store;
+    commit(store, "group-1", "topic-1", 0, 10);
+    commit(store, "group-1", "topic-1", 1, 10);
+    commit(store, "group-2", "topic-1", 1, 20);
+    commit(store, "group-2", "topic-2", 0, 30);
+    store.publish();
+
+    EXPECT_EQ(vector<string>({ "group-1", "group-2" }),
+              sorted(store.get_topic_consumers("topic-1")));
+    EXPECT_EQ(vector<string>({ "group-2" }), store.get_topic_consumers("topic-2"));
+    EXPECT_TRUE(store.get_topic_consumers("topic-3").empty());
+    EXPECT_EQ(3u, store.get_topic_consumer_offsets("topic-1").size());
+    EXPECT_EQ(2u, store.get_topic_consumer_offsets("topic-1", 1).size());
+    EXPECT_EQ(1u, store.get_topic_consumer_offsets("topic-1", 0).size());
+
+    // Groups stay on the topic until their last partition on it is gone
+    store.remove_consumer_offset("group-1", "topic-1", 0);
+    store.publish();
+    EXPECT_EQ(vector<string>({ "group-1", "group-2" }),
+              sorted(store.get_topic_consumers("topic-1")));
+    store.remove_consumer_offset("group-1", "topic-1", 1);
+    store.publish();
+    EXPECT_EQ(vector<string>({ "group-2" }), store.get_topic_consumers("topic-1"));
+    EXPECT_TRUE(store.get_topic_consumer_offsets("topic-1", 0).empty());
+}
+
+TEST_F(OffsetStoreTest, ComputeAllLags) {
+    OffsetStore store;
+    commit(store, "group-1", "topic-1", 0, 10);
+    // Ahead of the watermark
+    commit(store, "group-1", "topic-1", 1, 150);
+    // No watermark
+    commit(store, "group-2", "topic-2", 0, 5);
+    commit(store, "inactive", "topic-1", 0, 50);
+    store.store_consumer_group_state("inactive", OffsetStore::ConsumerGroupState::EMPTY);
+    store.store_topic_offset("topic-1", 0, 100);
+    store.store_topic_offset("topic-1", 1, 100);
+    store.publish();
+
+    const LagMap expected = {
+        { make_tuple("group-1", "topic-1", 0), 90 },
+        { make_tuple("group-1", "topic-1", 1), 0 },
+        { make_tuple("inactive", "topic-1", 0), 50 }
+    };
+    const OffsetStore::LagColumns columns = store.compute_all_lags();
+    EXPECT_EQ(expected, get_lags(columns));
+    // Only groups and topics with a known lag are listed
+    EXPECT_EQ(2u, columns.group_ids.size());
+    EXPECT_EQ(1u, columns.topics.size());
+    EXPECT_EQ(vector<int64_t>({ 100, 100, 100 }), columns.topic_offsets);
+
+    LagMap visited;
+    store.visit_all_lags([&](const string& group_id, const string& topic, int partition,
+                             int64_t consumer_offset, int64_t topic_offset, int64_t lag) {
+        visited.emplace(make_tuple(group_id, topic, partition), lag);
+    });
+    EXPECT_EQ(expected, visited);
+
+    store.set_ignore_inactive_consumers(true);
+    const LagMap active_lags = get_lags(store.compute_all_lags());
+    EXPECT_EQ(2u, active_lags.size());
+    EXPECT_FALSE(active_lags.count(make_tuple("inactive", "topic-1", 0)));
+}
+
+TEST_F(OffsetStoreTest, LagRollups) {
+    OffsetStore store;
+    store.set_lag_rollups_enabled(true);
+    commit(store, "group-1", "topic-1", 0, 10);
+    commit(store, "group-1", "topic-1", 1, 20);
+    commit(store, "group-1", "topic-2", 0, 0);
+    commit(store, "group-2", "topic-1", 0, 90);
+    store.store_topic_offset("topic-1", 0, 100);
+    store.store_topic_offset("topic-1", 1, 100);
+    // Rollups are only updated when publishing
+    EXPECT_FALSE(store.get_consumer_lag("group-1"));
+    store.publish();
+
+    ASSERT_TRUE(store.get_consumer_lag("group-1"));
+    EXPECT_EQ(170, store.get_consumer_lag("group-1")->total_lag);
+    // topic-2 has no watermark yet
+    EXPECT_EQ(2u, store.get_consumer_lag("group-1")->offset_count);
+    ASSERT_TRUE(store.get_consumer_lag("group-1", "topic-1"));
+    EXPECT_EQ(170, store.get_consumer_lag("group-1", "topic-1")->total_lag);
+    EXPECT_EQ(optional<int64_t>(90), store.get_consumer_max_lag("group-1", "topic-1"));
+    ASSERT_TRUE(store.get_topic_lag("topic-1"));
+    EXPECT_EQ(180, store.get_topic_lag("topic-1")->total_lag);
+    EXPECT_FALSE(store.get_topic_lag("topic-2"));
+
+    store.store_topic_offset("topic-2", 0, 5);
+    commit(store, "group-1", "topic-1", 0, 100);
+    store.remove_consumer_offset("group-2", "topic-1", 0);
+    // Inactive groups still count
+    store.store_consumer_group_state("group-1", OffsetStore::ConsumerGroupState::EMPTY);
+    store.publish();
+    EXPECT_EQ(85, store.get_consumer_lag("group-1")->total_lag);
+    EXPECT_EQ(3u, store.get_consumer_lag("group-1")->offset_count);
+    EXPECT_EQ(80, store.get_topic_lag("topic-1")->total_lag);
+    EXPECT_FALSE(store.get_consumer_lag("group-2"));
+}
+
+TEST_F(OffsetStoreTest, LargestLags) {
+    using ConsumerGroupState = OffsetStore::ConsumerGroupState;
+    OffsetStore store;
+    store.set_lag_rollups_enabled(true);
+    store.store_topic_offset("topic", 0, 100);
+    store.store_topic_offset("topic", 1, 100);
+    commit(store, "group-1", "topic", 0, 10);
+    commit(store, "group-1", "topic", 1, 60);
+    commit(store, "group-2", "topic", 0, 30);
+    commit(store, "group-3", "topic", 0, 95);
+    store.publish();
+
+    vector<pirulo::LagRollups::PartitionLag> partition_lags =
+        store.get_largest_partition_lags(2);
+    ASSERT_EQ(2u, partition_lags.size());
+    EXPECT_EQ("group-1", partition_lags[0].group_id);
+    EXPECT_EQ(90, partition_lags[0].lag);
+    EXPECT_EQ("group-2", partition_lags[1].group_id);
+    vector<pirulo::LagRollups::GroupLag> group_lags = store.get_largest_consumer_lags(10);
+    ASSERT_EQ(3u, group_lags.size());
+    EXPECT_EQ("group-1", group_lags[0].group_id);
+    EXPECT_EQ(130, group_lags[0].total_lag);
+
+    // Groups without members leave the heaps until they're active again
+    store.store_consumer_group_state("group-1", ConsumerGroupState::EMPTY);
+    store.publish();
+    group_lags = store.get_largest_consumer_lags(10);
+    ASSERT_EQ(2u, group_lags.size());
+    EXPECT_EQ("group-2", group_lags[0].group_id);
+    EXPECT_EQ("group-2", store.get_largest_partition_lags(1)[0].group_id);
+
+    store.store_consumer_group_state("group-1", ConsumerGroupState::ACTIVE);
+    commit(store, "group-2", "topic", 0, 100);
+    store.publish();
+    group_lags = store.get_largest_consumer_lags(10);
+    ASSERT_EQ(3u, group_lags.size());
+    EXPECT_EQ("group-1", group_lags[0].group_id);
+    EXPECT_EQ("group-3", group_lags[1].group_id);
+    EXPECT_EQ(0, group_lags[2].total_lag);
+}
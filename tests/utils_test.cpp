@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "utils/utils.h"
+#include "exceptions.h"
+
+using pirulo::utils::get_group_offsets_partition;
+
+// Expected partitions are abs(String.hashCode()) % partitions, as computed by the broker
+
+TEST(GroupOffsetsPartitionTest, Ascii) {
+    EXPECT_EQ(4, get_group_offsets_partition("abc", 50));
+    EXPECT_EQ(13, get_group_offsets_partition("my-consumer-group", 50));
+    EXPECT_EQ(10, get_group_offsets_partition("console-consumer-40221", 50));
+    EXPECT_EQ(6, get_group_offsets_partition("abc", 7));
+    EXPECT_EQ(0, get_group_offsets_partition("", 50));
+}
+
+TEST(GroupOffsetsPartitionTest, NegativeHash) {
+    // "orders".hashCode() is -1008770331
+    EXPECT_EQ(31, get_group_offsets_partition("orders", 50));
+}
+
+TEST(GroupOffsetsPartitionTest, MinimumHash) {
+    // Its hash is Integer.MIN_VALUE, which kafka's Utils.abs maps to 0
+    EXPECT_EQ(0, get_group_offsets_partition("polygenelubricants", 50));
+    EXPECT_EQ(0, get_group_offsets_partition("polygenelubricants", 7));
+}
+
+TEST(GroupOffsetsPartitionTest, Collisions) {
+    EXPECT_EQ(get_group_offsets_partition("Aa", 50), get_group_offsets_partition("BB", 50));
+}
+
+TEST(GroupOffsetsPartitionTest, MultiByteCharacters) {
+    // Two byte UTF-8 sequences are a single UTF-16 unit
+    EXPECT_EQ(23, get_group_offsets_partition("gr\xc3\xbc\xc3\x9f" "e", 50));
+    // Characters outside the BMP are hashed as a surrogate pair
+    EXPECT_EQ(6, get_group_offsets_partition("emoji-\xf0\x9f\x98\x80", 50));
+}
+
+TEST(GroupOffsetsPartitionTest, InvalidPartitionCount) {
+    EXPECT_THROW(get_group_offsets_partition("abc", 0), pirulo::Exception);
+    EXPECT_THROW(get_group_offsets_partition("abc", -1), pirulo::Exception);
+}